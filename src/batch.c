@@ -0,0 +1,174 @@
+#include "batch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "machine.h"
+
+// a ring of the machines a thread is going to run. Every machine is in
+// exactly one queue or being run, so a queue never holds more than all of
+// them. The owner takes from the back and thieves from the front
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    int *instances;
+    int front;
+    int size;
+} WorkQueue;
+
+typedef struct Batch {
+    State **states;
+    int count;
+    const Engine *engine;
+    long frames;
+    FrameHook beforeFrame;
+    void *context;
+
+    long *framesRun; // frames each machine has run
+    atomic_int unfinished; // machines that haven't run all their frames
+    int threads;
+    WorkQueue *queues;
+} Batch;
+
+typedef struct Worker {
+    Batch *batch;
+    int index;
+} Worker;
+
+static void pushBack(WorkQueue *queue, int count, int instance) {
+    pthread_mutex_lock(&queue->lock);
+    queue->instances[(queue->front + queue->size) % count] = instance;
+    queue->size++;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// returns the machine taken from the queue, or -1 if it was empty
+static int take(WorkQueue *queue, int count, int fromFront) {
+    int instance = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->size > 0) {
+        if (fromFront) {
+            instance = queue->instances[queue->front];
+            queue->front = (queue->front + 1) % count;
+        } else {
+            instance =
+                queue->instances[(queue->front + queue->size - 1) % count];
+        }
+        queue->size--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return instance;
+}
+
+// takes work from the thread's own queue, or steals it from the next thread
+// along that has some
+static int findWork(Batch *batch, int self) {
+    int instance = take(&batch->queues[self], batch->count, 0);
+    for (int i = 1; instance < 0 && i < batch->threads; i++) {
+        instance = take(&batch->queues[(self + i) % batch->threads],
+                        batch->count, 1);
+    }
+    return instance;
+}
+
+static void *runWorker(void *argument) {
+    Worker *worker = argument;
+    Batch *batch = worker->batch;
+
+    while (atomic_load(&batch->unfinished) > 0) {
+        int instance = findWork(batch, worker->index);
+        if (instance < 0) {
+            // the last machines are being run by other threads
+            sched_yield();
+            continue;
+        }
+
+        State *state = batch->states[instance];
+        long *frame = &batch->framesRun[instance];
+        for (int i = 0; i < BATCH_SLICE_FRAMES && *frame < batch->frames;
+             i++, (*frame)++) {
+            if (batch->beforeFrame != NULL) {
+                batch->beforeFrame(state, instance, *frame, batch->context);
+            }
+            runFrame(state, batch->engine);
+        }
+
+        if (*frame < batch->frames) {
+            pushBack(&batch->queues[worker->index], batch->count, instance);
+        } else {
+            atomic_fetch_sub(&batch->unfinished, 1);
+        }
+    }
+    return NULL;
+}
+
+int runBatch(State **states, int count, const Engine *engine, long frames,
+             int threads, FrameHook beforeFrame, void *context) {
+    if (threads > count) {
+        threads = count;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    Batch batch = {
+        .states = states,
+        .count = count,
+        .engine = engine,
+        .frames = frames,
+        .beforeFrame = beforeFrame,
+        .context = context,
+        .threads = threads,
+        .framesRun = calloc(count, sizeof(long)),
+        .queues = calloc(threads, sizeof(WorkQueue)),
+    };
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    Worker *workers = calloc(threads, sizeof(Worker));
+    int *instances = calloc((size_t)threads * count, sizeof(int));
+    if (batch.framesRun == NULL || batch.queues == NULL || ids == NULL ||
+        workers == NULL || instances == NULL) {
+        perror("Failed to allocate the batch");
+        free(batch.framesRun);
+        free(batch.queues);
+        free(ids);
+        free(workers);
+        free(instances);
+        return -1;
+    }
+
+    // the machines start out dealt evenly between the threads
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&batch.queues[i].lock, NULL);
+        batch.queues[i].instances = instances + (size_t)i * count;
+    }
+    for (int instance = 0; instance < count; instance++) {
+        pushBack(&batch.queues[instance % threads], count, instance);
+    }
+    atomic_init(&batch.unfinished, count);
+
+    int started = 0;
+    for (; started < threads; started++) {
+        workers[started] = (Worker){&batch, started};
+        if (pthread_create(&ids[started], NULL, runWorker,
+                           &workers[started]) != 0) {
+            break;
+        }
+    }
+
+    // the threads that did start finish the batch between them
+    for (int i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&batch.queues[i].lock);
+    }
+    free(batch.framesRun);
+    free(batch.queues);
+    free(ids);
+    free(workers);
+    free(instances);
+    return started > 0 ? 0 : -1;
+}
@@ -0,0 +1,26 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cpu.h"
+
+// BATCH RUNS -- runs many independent machines for the same number of frames
+// on a pool of threads. Every thread has a queue of machines and runs
+// BATCH_SLICE_FRAMES frames of the machine at the back of its queue at a
+// time, putting it back until it is done. A thread whose queue is empty
+// steals from the front of the others, so machines that cost more than the
+// rest don't leave threads idle at the end. The machines share nothing but
+// their ROMs, which are read only, so they need no locking
+#define BATCH_SLICE_FRAMES 16
+
+// called before each frame of a machine, e.g. to set its inputs. instance is
+// the index of the machine and frame the number of frames it has run
+typedef void (*FrameHook)(State *state, int instance, long frame,
+                          void *context);
+
+// runs every machine for frames frames with the engine, on threads threads.
+// beforeFrame can be NULL. Returns 0 on success and -1 if the threads
+// couldn't be started
+int runBatch(State **states, int count, const Engine *engine, long frames,
+             int threads, FrameHook beforeFrame, void *context);
+
+#endif
@@ -0,0 +1,1147 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "cpm.h"
+#include "cpu.h"
+#include "fork.h"
+#include "lockstep.h"
+#include "machine.h"
+#include "memory.h"
+#include "ports.h"
+#include "rewind.h"
+#include "rom.h"
+#include "trace.h"
+#include "video.h"
+
+// default number of cycles each engine runs per workload
+#define DEFAULT_CYCLES 100000000
+
+// the engines are given this many cycles per call, the same as the main loop
+// in main.c
+#define CYCLES_PER_BATCH 16667
+
+// where the workloads keep their data
+#define DATA_START 0x4000
+#define DATA_SIZE 0x2000
+
+// a small 8080 program that loops forever
+typedef struct Workload {
+    const char *name;
+    const uint8_t *program;
+    size_t size;
+} Workload;
+
+// ALU heavy loop, every instruction in the body touches the flags
+static const uint8_t aluProgram[] = {
+    0x06, 0x01,       // 0000 MVI B,01
+    0x0e, 0x03,       // 0002 MVI C,03
+    0x80,             // 0004 ADD B
+    0x91,             // 0005 SUB C
+    0x88,             // 0006 ADC B
+    0x99,             // 0007 SBB C
+    0xa0,             // 0008 ANA B
+    0xb1,             // 0009 ORA C
+    0xa8,             // 000a XRA B
+    0xb9,             // 000b CMP C
+    0x3c,             // 000c INR A
+    0x05,             // 000d DCR B
+    0x0c,             // 000e INR C
+    0x87,             // 000f ADD A
+    0xc3, 0x04, 0x00, // 0010 JMP 0004
+};
+
+// copies 0x4000-0x4fff to 0x5000-0x5fff over and over
+static const uint8_t memoryProgram[] = {
+    0x21, 0x00, 0x40, // 0000 LXI H,4000
+    0x11, 0x00, 0x50, // 0003 LXI D,5000
+    0x7e,             // 0006 MOV A,M
+    0x12,             // 0007 STAX D
+    0x23,             // 0008 INX H
+    0x13,             // 0009 INX D
+    0x7c,             // 000a MOV A,H
+    0xe6, 0x0f,       // 000b ANI 0f
+    0xf6, 0x40,       // 000d ORI 40
+    0x67,             // 000f MOV H,A
+    0x7a,             // 0010 MOV A,D
+    0xe6, 0x0f,       // 0011 ANI 0f
+    0xf6, 0x50,       // 0013 ORI 50
+    0x57,             // 0015 MOV D,A
+    0xc3, 0x06, 0x00, // 0016 JMP 0006
+};
+
+// a mix of loads, stores, ALU, stack, call and branch instructions
+static const uint8_t mixedProgram[] = {
+    0x31, 0x00, 0x80, // 0000 LXI SP,8000
+    0x21, 0x00, 0x40, // 0003 LXI H,4000
+    0x06, 0x00,       // 0006 MVI B,00
+    0x0e, 0x00,       // 0008 MVI C,00
+    0x7e,             // 000a MOV A,M
+    0x80,             // 000b ADD B
+    0xa9,             // 000c XRA C
+    0x77,             // 000d MOV M,A
+    0x4f,             // 000e MOV C,A
+    0x23,             // 000f INX H
+    0x04,             // 0010 INR B
+    0xcd, 0x18, 0x00, // 0011 CALL 0018
+    0xc2, 0x0a, 0x00, // 0014 JNZ 000a
+    0x76,             // 0017 HLT
+    0x7c,             // 0018 MOV A,H
+    0xe6, 0x0f,       // 0019 ANI 0f
+    0xf6, 0x40,       // 001b ORI 40 (never zero, so the JNZ is always taken)
+    0x67,             // 001d MOV H,A
+    0xc5,             // 001e PUSH B
+    0xd1,             // 001f POP D
+    0xc9,             // 0020 RET
+};
+
+// conditional jumps, calls and returns that read the flags, and PUSH/POP PSW
+static const uint8_t branchProgram[] = {
+    0x31, 0x00, 0x80, // 0000 LXI SP,8000
+    0x06, 0x00,       // 0003 MVI B,00
+    0x04,             // 0005 INR B
+    0x78,             // 0006 MOV A,B
+    0xe6, 0x01,       // 0007 ANI 01
+    0xca, 0x10, 0x00, // 0009 JZ 0010
+    0xf5,             // 000c PUSH PSW
+    0xf1,             // 000d POP PSW
+    0x37,             // 000e STC
+    0x3f,             // 000f CMC
+    0x78,             // 0010 MOV A,B
+    0xfe, 0x80,       // 0011 CPI 80
+    0xdc, 0x1d, 0x00, // 0013 CC 001d
+    0xea, 0x05, 0x00, // 0016 JPE 0005
+    0xc3, 0x05, 0x00, // 0019 JMP 0005
+    0x76,             // 001c HLT
+    0xf5,             // 001d PUSH PSW
+    0xb7,             // 001e ORA A
+    0xf1,             // 001f POP PSW
+    0xd8,             // 0020 RC
+    0xc9,             // 0021 RET
+};
+
+// RANDOM WORKLOAD -- a long loop of randomly picked instructions that read
+// and write the flags in every possible order. It exists to catch any engine
+// that works out a flag differently from the switch engine
+
+#define RANDOM_PROGRAM_SIZE 0x1000
+#define RANDOM_BODY_START 0x0006
+#define RANDOM_INSTRUCTIONS 1500
+#define RANDOM_SUBROUTINES 0x0f00
+
+static uint8_t randomProgram[RANDOM_PROGRAM_SIZE];
+
+// instructions that only touch registers and flags, so they can go anywhere
+static const uint8_t randomOpcodes[] = {
+    0x03, 0x04, 0x05, 0x07, 0x09, 0x0b, 0x0c, 0x0d, 0x0f, 0x13, 0x14, 0x15,
+    0x17, 0x19, 0x1b, 0x1c, 0x1d, 0x1f, 0x23, 0x24, 0x25, 0x27, 0x29, 0x2b,
+    0x2c, 0x2d, 0x2f, 0x37, 0x3c, 0x3d, 0x3f, 0x41, 0x4a, 0x53, 0x5c, 0x65,
+    0x6f, 0x78, 0x7e, 0x80, 0x81, 0x86, 0x87, 0x88, 0x8a, 0x8e, 0x8f, 0x90,
+    0x93, 0x96, 0x97, 0x98, 0x9c, 0x9e, 0x9f, 0xa0, 0xa5, 0xa6, 0xa7, 0xa8,
+    0xab, 0xae, 0xaf, 0xb0, 0xb2, 0xb6, 0xb7, 0xb8, 0xbd, 0xbe, 0xbf,
+};
+
+// instructions followed by a one byte immediate
+static const uint8_t randomImmediateOpcodes[] = {
+    0x06, 0x0e, 0x16, 0x1e, 0x26, 0x2e, 0x3e,
+    0xc6, 0xce, 0xd6, 0xe6, 0xee, 0xf6, 0xfe,
+};
+
+// conditional jumps, calls and returns in the order of their condition codes
+static const uint8_t conditionalJumps[] = {0xc2, 0xca, 0xd2, 0xda,
+                                           0xe2, 0xea, 0xf2, 0xfa};
+static const uint8_t conditionalCalls[] = {0xc4, 0xcc, 0xd4, 0xdc,
+                                           0xe4, 0xec, 0xf4, 0xfc};
+static const uint8_t conditionalReturns[] = {0xc0, 0xc8, 0xd0, 0xd8,
+                                             0xe0, 0xe8, 0xf0, 0xf8};
+
+// small linear congruential generator, so the program is the same everywhere
+static uint32_t nextRandom(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+static void emit(uint16_t *address, uint8_t byte) {
+    randomProgram[(*address)++] = byte;
+}
+
+static void emitWord(uint16_t *address, uint16_t word) {
+    emit(address, word & 0xff);
+    emit(address, word >> 8);
+}
+
+static void generateRandomProgram() {
+    uint32_t seed = 8080;
+    uint16_t address = 0;
+
+    emit(&address, 0x31); // LXI SP,8000
+    emitWord(&address, 0x8000);
+    emit(&address, 0x21); // LXI H,4000
+    emitWord(&address, 0x4000);
+
+    for (int i = 0; i < RANDOM_INSTRUCTIONS; i++) {
+        uint32_t kind = nextRandom(&seed) % 16;
+        uint32_t condition = nextRandom(&seed) % 8;
+
+        if (kind < 9) {
+            emit(&address, randomOpcodes[nextRandom(&seed) %
+                                         sizeof(randomOpcodes)]);
+        } else if (kind < 12) {
+            emit(&address, randomImmediateOpcodes[nextRandom(&seed) %
+                                                  sizeof(randomImmediateOpcodes)]);
+            emit(&address, (uint8_t)nextRandom(&seed));
+        } else if (kind == 12) {
+            // both ways lead to the next instruction
+            emit(&address, conditionalJumps[condition]);
+            emitWord(&address, address + 2);
+        } else if (kind == 13) {
+            // each subroutine is a conditional return followed by a RET
+            emit(&address, conditionalCalls[condition]);
+            emitWord(&address,
+                     RANDOM_SUBROUTINES + 2 * (nextRandom(&seed) % 8));
+        } else if (kind == 14) {
+            emit(&address, 0xf5); // PUSH PSW
+            emit(&address, 0xc1); // POP B
+        } else {
+            emit(&address, 0xc5); // PUSH B
+            emit(&address, 0xf1); // POP PSW
+        }
+    }
+
+    emit(&address, 0xc3); // JMP to the start of the body
+    emitWord(&address, RANDOM_BODY_START);
+
+    for (int i = 0; i < 8; i++) {
+        randomProgram[RANDOM_SUBROUTINES + 2 * i] = conditionalReturns[i];
+        randomProgram[RANDOM_SUBROUTINES + 2 * i + 1] = 0xc9; // RET
+    }
+}
+
+static const Workload workloads[] = {
+    {"alu", aluProgram, sizeof(aluProgram)},
+    {"memory", memoryProgram, sizeof(memoryProgram)},
+    {"mixed", mixedProgram, sizeof(mixedProgram)},
+    {"branch", branchProgram, sizeof(branchProgram)},
+    {"random", randomProgram, sizeof(randomProgram)},
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static State *setupWorkload(const Workload *workload) {
+    State *state = setupStateMachine();
+    memcpy(state->memory, workload->program, workload->size);
+
+    // gives the data area something other than zeroes to work on
+    for (int i = 0; i < DATA_SIZE; i++) {
+        state->memory[DATA_START + i] = (uint8_t)(i * 7 + 3);
+    }
+    return state;
+}
+
+static void freeWorkload(State *state) {
+    freeStateMachine(state);
+}
+
+// runs the engine in batches until the machine has executed the given number
+// of cycles
+static void runEngine(State *state, int (*run)(State *, int), long cycles) {
+    while (state->cycles < (uint64_t)cycles) {
+        run(state, CYCLES_PER_BATCH);
+    }
+}
+
+static int registersMatch(State *left, State *right) {
+    return left->a == right->a && left->b == right->b &&
+           left->c == right->c && left->d == right->d &&
+           left->e == right->e && left->h == right->h &&
+           left->l == right->l && left->sp == right->sp &&
+           left->pc == right->pc && left->flags == right->flags &&
+           left->interruptEnabled == right->interruptEnabled &&
+           left->halted == right->halted &&
+           left->cycles == right->cycles;
+}
+
+// returns 1 if both machines ended up in exactly the same state
+static int statesMatch(State *left, State *right) {
+    return registersMatch(left, right) &&
+           memcmp(left->memory, right->memory, MEMORY_SIZE) == 0;
+}
+
+// ENGINES -- every engine runs the same machine from the same start for the
+// same number of cycles, and is checked against the switch engine. The
+// machines are the synthetic workloads, space invaders from power on into
+// its attract mode when bench is given the ROM set, and the CP/M test
+// programs in the test directory, which stop early when they finish. With
+// --json every run is also written to a file, to keep track of the numbers
+// over time
+
+typedef struct EngineRun {
+    const char *name;
+    // returns the machine at its start, or NULL if it failed to load
+    State *(*setup)(const void *source);
+    // runs the machine with the engine until it has used cycles cycles
+    void (*run)(State *state, const Engine *engine, long cycles);
+    const void *source;
+} EngineRun;
+
+// where --json writes the runs, NULL without it
+static FILE *json;
+static int jsonRuns;
+
+static State *setupSynthetic(const void *source) {
+    return setupWorkload(source);
+}
+
+static State *setupAttract(const void *source) {
+    uint16_t addresses[INVADERS_PART_COUNT];
+    for (int i = 0; i < INVADERS_PART_COUNT; i++) {
+        addresses[i] = invadersRomSet[i].address;
+    }
+    return setupSpaceInvaders(source, addresses, INVADERS_PART_COUNT);
+}
+
+static State *setupTestProgram(const void *source) {
+    State *state = setupStateMachine();
+    if (loadCpmProgram(state, source, NULL) < 0) {
+        freeWorkload(state);
+        return NULL;
+    }
+    return state;
+}
+
+static void runCycles(State *state, const Engine *engine, long cycles) {
+    runEngine(state, engine->run, cycles);
+}
+
+static void runFrames(State *state, const Engine *engine, long cycles) {
+    while (state->cycles < (uint64_t)cycles) {
+        runFrame(state, engine);
+    }
+}
+
+static void runTestProgram(State *state, const Engine *engine, long cycles) {
+    while (state->cycles < (uint64_t)cycles && !cpmFinished(state)) {
+        engine->run(state, CYCLES_PER_BATCH);
+    }
+}
+
+// the switch engine, counting the instructions it runs. Every engine stops
+// at the same instruction, so the count holds for all of them
+static long countedInstructions;
+
+static int runCounted(State *state, int cycles) {
+    uint64_t start = state->cycles;
+    while (state->cycles < start + cycles) {
+        Emulate(state);
+        countedInstructions++;
+    }
+    return (int)(state->cycles - start);
+}
+
+static void writeJsonRun(const char *workload, const char *engine,
+                         long instructions, uint64_t cycles, double time,
+                         int match) {
+    fprintf(json,
+            "%s\n    {\"workload\": \"%s\", \"engine\": \"%s\", "
+            "\"instructions\": %ld, \"cycles\": %llu, \"seconds\": %.6f, "
+            "\"instructions_per_second\": %.0f, \"cycles_per_second\": %.0f, "
+            "\"ns_per_instruction\": %.3f, \"match\": %s}",
+            jsonRuns++ > 0 ? "," : "", workload, engine, instructions,
+            (unsigned long long)cycles, time, instructions / time,
+            cycles / time, time * 1e9 / instructions,
+            match ? "true" : "false");
+}
+
+// returns the number of engines that didn't match the switch engine, or 1 if
+// the machine failed to load
+static int benchEngines(const EngineRun *run, long cycles) {
+    State *counted = run->setup(run->source);
+    if (counted == NULL) {
+        return 1;
+    }
+    const Engine counting = {"counted", runCounted};
+    countedInstructions = 0;
+    run->run(counted, &counting, cycles);
+    long instructions = countedInstructions;
+    freeWorkload(counted);
+
+    int failures = 0;
+    State *reference = NULL;
+    double referenceTime = 0;
+    for (int i = 0; i < engineCount; i++) {
+        State *state = run->setup(run->source);
+
+        double start = now();
+        run->run(state, &engines[i], cycles);
+        double time = now() - start;
+
+        int match = 1;
+        if (reference == NULL) {
+            reference = state;
+            referenceTime = time;
+        } else {
+            match = statesMatch(reference, state);
+            failures += !match;
+        }
+
+        printf("%-12s %-10s %10.1f %10.1f %9.2f %8.2fx %6s\n", run->name,
+               engines[i].name, instructions / time / 1e6,
+               state->cycles / time / 1e6, time * 1e9 / instructions,
+               referenceTime / time, match ? "yes" : "NO");
+        if (json != NULL) {
+            writeJsonRun(run->name, engines[i].name, instructions,
+                         state->cycles, time, match);
+        }
+
+        if (state != reference) {
+            freeWorkload(state);
+        }
+    }
+    freeWorkload(reference);
+    return failures;
+}
+
+// times of a single run are well within the noise, so the fastest of this
+// many runs of each is compared
+#define TRACE_RUNS 5
+
+// runs the workload on the engine from a fresh machine, with the records
+// going to /dev/null when traced is set. Returns the time it took, or -1 if
+// the trace couldn't be started, and leaves the machine in *result
+static double timeTraceRun(const Workload *workload,
+                           int (*engine)(State *, int), int traced,
+                           long cycles, State **result) {
+    State *state = setupWorkload(workload);
+    if (traced) {
+        state->trace = startTrace("/dev/null");
+        if (state->trace == NULL) {
+            freeWorkload(state);
+            return -1;
+        }
+    }
+
+    double start = now();
+    runEngine(state, engine, cycles);
+    if (traced) {
+        stopTrace(state->trace);
+        state->trace = NULL;
+    }
+    double time = now() - start;
+
+    *result = state;
+    return time;
+}
+
+// runs every workload on the threaded engine with and without tracing, and
+// checks that tracing doesn't change what the program does. The records go to
+// /dev/null, so this is the cost of tracing without the disk. Returns the
+// number of workloads that didn't match
+static int benchTrace(long cycles) {
+    printf("\n%-10s %12s %12s %9s %6s\n", "workload", "threaded ms",
+           "traced ms", "overhead", "match");
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        double plainTime = 0;
+        double tracedTime = 0;
+        int match = 1;
+        for (int run = 0; run < TRACE_RUNS; run++) {
+            State *plain;
+            State *traced;
+            double time = timeTraceRun(&workloads[i], EmulateThreaded, 0,
+                                       cycles, &plain);
+            plainTime = run == 0 || time < plainTime ? time : plainTime;
+            time = timeTraceRun(&workloads[i], EmulateTraced, 1, cycles,
+                                &traced);
+            if (time < 0) {
+                freeWorkload(plain);
+                return failures + 1;
+            }
+            tracedTime = run == 0 || time < tracedTime ? time : tracedTime;
+
+            match = match && statesMatch(plain, traced);
+            freeWorkload(plain);
+            freeWorkload(traced);
+        }
+
+        failures += !match;
+        printf("%-10s %12.1f %12.1f %8.2fx %6s\n", workloads[i].name,
+               plainTime * 1e3, tracedTime * 1e3, tracedTime / plainTime,
+               match ? "yes" : "NO");
+    }
+    return failures;
+}
+
+// frames every renderer converts
+#define RENDER_FRAMES 2000
+
+// times every renderer the cpu supports on the same video RAM and checks that
+// each one draws the same picture as the scalar one. Returns the number of
+// renderers that drew something different
+static int benchRenderers() {
+    static uint8_t video[VIDEO_RAM_SIZE];
+    static uint8_t expected[SCREEN_WIDTH * SCREEN_HEIGHT];
+    static uint8_t pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    uint32_t seed = 8080;
+    for (int i = 0; i < VIDEO_RAM_SIZE; i++) {
+        video[i] = (uint8_t)nextRandom(&seed);
+    }
+    findRenderer("scalar")->render(video, expected, 0, SCREEN_WIDTH);
+
+    printf("\n%-10s %10s %10s %6s\n", "renderer", "us/frame", "frames/s",
+           "match");
+
+    int failures = 0;
+    for (int i = 0; i < rendererCount; i++) {
+        if (!renderers[i].available()) {
+            printf("%-10s %10s\n", renderers[i].name, "n/a");
+            continue;
+        }
+
+        double start = now();
+        for (int frame = 0; frame < RENDER_FRAMES; frame++) {
+            video[frame % VIDEO_RAM_SIZE] ^= 0xff;
+            renderers[i].render(video, pixels, 0, SCREEN_WIDTH);
+            video[frame % VIDEO_RAM_SIZE] ^= 0xff;
+        }
+        double time = now() - start;
+
+        // every frame is flipped back, so the last one is the same picture
+        renderers[i].render(video, pixels, 0, SCREEN_WIDTH);
+        int match = memcmp(pixels, expected, sizeof(pixels)) == 0;
+        failures += !match;
+
+        printf("%-10s %10.2f %10.0f %6s\n", renderers[i].name,
+               time / RENDER_FRAMES * 1e6, RENDER_FRAMES / time,
+               match ? "yes" : "NO");
+    }
+    return failures;
+}
+
+// DIRTY COLUMNS -- renders every frame of attract mode both in full and from
+// the dirty columns, and checks that both give the same picture. Attract mode
+// comes from the space invaders ROM when bench is given it, and from a
+// stand in that draws like it otherwise
+
+#define ATTRACT_FRAMES 1200
+
+// the stand in moves one 16 pixel wide invader a frame across a rack of them,
+// and a shot down the screen, all through the memory map like the game does
+static void drawAttractFrame(State *state, int frame) {
+    int invader = frame % 55;
+    int column = 24 + (invader % 11) * 16 + (frame / 55) % 8;
+    uint16_t address = VIDEO_RAM_START + column * BYTES_PER_COLUMN + 16 +
+                       (invader / 11) * 2;
+    for (int x = -1; x < 16; x++) {
+        uint8_t bits = x < 0 ? 0x00 : (uint8_t)(0x3c ^ (x * 0x11) ^ frame);
+        writeByte(state, address + x * BYTES_PER_COLUMN, bits);
+        writeByte(state, address + x * BYTES_PER_COLUMN + 1, bits >> 1);
+    }
+
+    uint16_t shot = VIDEO_RAM_START + (frame * 7 % SCREEN_WIDTH) *
+                                          BYTES_PER_COLUMN;
+    writeByte(state, shot + (frame % BYTES_PER_COLUMN), 0x0f);
+    writeByte(state, shot + ((frame + 5) % BYTES_PER_COLUMN), 0x00);
+}
+
+// a space invaders machine with its video writes tracked, running the ROM set
+// in romDirectory if there is one. Returns NULL if the ROM failed to load
+static State *setupAttractMode(const char *romDirectory, Rom *roms) {
+    State *state = setupStateMachine();
+    mapSpaceInvaders(state);
+    mapSpaceInvadersPorts(state);
+    if (romDirectory != NULL && loadRomSet(state, romDirectory, invadersRomSet,
+                                           INVADERS_PART_COUNT, roms) < 0) {
+        freeWorkload(state);
+        return NULL;
+    }
+    state->sp = 0x2400;
+    trackVideoWrites(state);
+    return state;
+}
+
+static void runAttractFrame(State *state, const char *romDirectory,
+                            int frame) {
+    if (romDirectory != NULL) {
+        runFrame(state, findEngine("threaded"));
+    } else {
+        drawAttractFrame(state, frame);
+    }
+}
+
+static void closeAttractMode(State *state, const char *romDirectory,
+                             Rom *roms) {
+    if (romDirectory != NULL) {
+        for (int i = 0; i < INVADERS_PART_COUNT; i++) {
+            closeRom(&roms[i]);
+        }
+    }
+    freeWorkload(state);
+}
+
+// returns 1 if the picture matches, 0 if not and -1 if the ROM failed to load
+static int benchDirtyColumns(const char *romDirectory) {
+    static uint8_t full[SCREEN_WIDTH * SCREEN_HEIGHT];
+    static uint8_t incremental[SCREEN_WIDTH * SCREEN_HEIGHT];
+    const Renderer *renderer = bestRenderer();
+
+    Rom roms[INVADERS_PART_COUNT];
+    State *state = setupAttractMode(romDirectory, roms);
+    if (state == NULL) {
+        return -1;
+    }
+
+    double fullTime = 0;
+    double incrementalTime = 0;
+    long dirtyColumns = 0;
+    int match = 1;
+    for (int frame = 0; frame < ATTRACT_FRAMES; frame++) {
+        runAttractFrame(state, romDirectory, frame);
+
+        for (int word = 0; word < DIRTY_COLUMN_WORDS; word++) {
+            dirtyColumns += __builtin_popcountll(state->dirtyColumns[word]);
+        }
+
+        double start = now();
+        renderer->render(videoRam(state), full, 0, SCREEN_WIDTH);
+        double middle = now();
+        renderDirtyColumns(state, renderer, incremental);
+        double end = now();
+
+        fullTime += middle - start;
+        incrementalTime += end - middle;
+        match &= memcmp(full, incremental, sizeof(full)) == 0;
+    }
+
+    printf("\n%s attract mode, %d frames, %.1f dirty columns a frame\n",
+           romDirectory != NULL ? "space invaders" : "stand in",
+           ATTRACT_FRAMES, (double)dirtyColumns / ATTRACT_FRAMES);
+    printf("%-12s %10s %9s %6s\n", "conversion", "us/frame", "speedup",
+           "match");
+    printf("%-12s %10.2f %8.2fx %6s\n", "full", fullTime / ATTRACT_FRAMES * 1e6,
+           1.0, "-");
+    printf("%-12s %10.2f %8.2fx %6s\n", "incremental",
+           incrementalTime / ATTRACT_FRAMES * 1e6, fullTime / incrementalTime,
+           match ? "yes" : "NO");
+
+    closeAttractMode(state, romDirectory, roms);
+    return match;
+}
+
+// REWIND -- keeps every frame of attract mode in a rewind buffer, then steps
+// back to the middle of it and checks that the machine is exactly as it was
+// there
+
+// returns 1 if the machine matches, 0 if not and -1 if the ROM failed to load
+static int benchRewind(const char *romDirectory) {
+    static uint8_t savedMemory[MEMORY_SIZE];
+    static State saved;
+
+    Rom roms[INVADERS_PART_COUNT];
+    State *state = setupAttractMode(romDirectory, roms);
+    if (state == NULL) {
+        return -1;
+    }
+    Rewind *rewind = createRewind(state, ATTRACT_FRAMES, 64 * 1024 * 1024);
+    if (rewind == NULL) {
+        closeAttractMode(state, romDirectory, roms);
+        return -1;
+    }
+
+    int middle = ATTRACT_FRAMES / 2;
+    double pushTime = 0;
+    for (int frame = 0; frame < ATTRACT_FRAMES; frame++) {
+        runAttractFrame(state, romDirectory, frame);
+
+        double start = now();
+        rewindPush(rewind, state);
+        pushTime += now() - start;
+
+        if (frame == middle) {
+            saved = *state;
+            memcpy(savedMemory, state->memory, MEMORY_SIZE);
+            saved.memory = savedMemory;
+        }
+    }
+
+    int frames = ATTRACT_FRAMES - 1 - middle;
+    size_t used = rewindMemoryUsed(rewind);
+    double start = now();
+    int stepped = rewindFrames(rewind, state, frames);
+    double rewindTime = now() - start;
+    int match = stepped == frames && statesMatch(&saved, state);
+
+    printf("\nrewind, %d frames kept in %zuKB of %zuKB\n", ATTRACT_FRAMES,
+           used / 1024, rewindMemory(rewind) / 1024);
+    printf("%-12s %10s %6s\n", "operation", "us/frame", "match");
+    printf("%-12s %10.2f %6s\n", "push", pushTime / ATTRACT_FRAMES * 1e6,
+           "-");
+    printf("%-12s %10.2f %6s\n", "step back", rewindTime / frames * 1e6,
+           match ? "yes" : "NO");
+
+    freeRewind(rewind);
+    closeAttractMode(state, romDirectory, roms);
+    return match;
+}
+
+// BATCH -- runs many machines at once on 1, 2, 4, ... threads up to one per
+// core, and checks that every machine ends up where the first one of the
+// single thread run did. With the ROM set they are space invaders machines
+// sharing the mapped ROM files, otherwise each runs the mixed workload
+
+#define BATCH_INSTANCES 256
+#define BATCH_FRAMES 120
+
+// returns 1 if every machine matches, 0 if not and -1 if the ROM failed to
+// load
+static int benchBatch(const char *romDirectory) {
+    Rom roms[INVADERS_PART_COUNT];
+    uint16_t addresses[INVADERS_PART_COUNT];
+    if (romDirectory != NULL) {
+        if (openRomSet(romDirectory, invadersRomSet, INVADERS_PART_COUNT,
+                       roms) < 0) {
+            return -1;
+        }
+        for (int i = 0; i < INVADERS_PART_COUNT; i++) {
+            addresses[i] = invadersRomSet[i].address;
+        }
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("\nbatch of %d %s machines, %d frames each, %ld cores\n",
+           BATCH_INSTANCES,
+           romDirectory != NULL ? "space invaders" : "mixed workload",
+           BATCH_FRAMES, cores);
+    printf("%-8s %12s %9s %6s\n", "threads", "frames/s", "scaling", "match");
+
+    static State *states[BATCH_INSTANCES];
+    State *reference = NULL;
+    double singleRate = 0;
+    int match = 1;
+    for (long threads = 1;; threads *= 2) {
+        if (threads > cores) {
+            threads = cores;
+        }
+
+        for (int i = 0; i < BATCH_INSTANCES; i++) {
+            states[i] = romDirectory != NULL
+                            ? setupSpaceInvaders(roms, addresses,
+                                                 INVADERS_PART_COUNT)
+                            : setupWorkload(&workloads[2]);
+        }
+
+        double start = now();
+        if (runBatch(states, BATCH_INSTANCES, findEngine("threaded"),
+                     BATCH_FRAMES, (int)threads, NULL, NULL) < 0) {
+            return -1;
+        }
+        double time = now() - start;
+
+        int threadsMatch = 1;
+        for (int i = 0; i < BATCH_INSTANCES; i++) {
+            if (reference == NULL) {
+                reference = states[i];
+                continue;
+            }
+            threadsMatch &= statesMatch(reference, states[i]);
+            freeWorkload(states[i]);
+        }
+        match &= threadsMatch;
+
+        double rate = BATCH_INSTANCES * BATCH_FRAMES / time;
+        if (threads == 1) {
+            singleRate = rate;
+        }
+        printf("%-8ld %12.0f %8.2fx %6s\n", threads, rate, rate / singleRate,
+               threadsMatch ? "yes" : "NO");
+
+        if (threads == cores) {
+            break;
+        }
+    }
+
+    freeWorkload(reference);
+    if (romDirectory != NULL) {
+        for (int i = 0; i < INVADERS_PART_COUNT; i++) {
+            closeRom(&roms[i]);
+        }
+    }
+    return match;
+}
+
+// LOCKSTEP -- runs LOCKSTEP_LANES machines frame by frame, one after another
+// on the threaded engine and then together in lockstep, and checks that every
+// machine ends up in the same place both ways. Every workload runs once with
+// the same machines, and once with machines that start with different data
+// and registers a few instructions apart, so they have to line up first and
+// can go different ways. With the ROM set the machines also run space
+// invaders, the varied ones putting their coins in at different frames
+
+#define LOCKSTEP_FRAMES 120
+
+// sets up machine lane, workload is an index into workloads or one past the
+// end for space invaders
+static State *setupLockstepMachine(int workload, int lane, int varied,
+                                   const Rom *roms,
+                                   const uint16_t *addresses) {
+    int workloadCount = sizeof(workloads) / sizeof(workloads[0]);
+    if (workload == workloadCount) {
+        return setupSpaceInvaders(roms, addresses, INVADERS_PART_COUNT);
+    }
+
+    // the machines share their program as a ROM, as they would share a game
+    static uint8_t program[RANDOM_PROGRAM_SIZE];
+    const Workload *chosen = &workloads[workload];
+    memset(program, 0, sizeof(program));
+    memcpy(program, chosen->program, chosen->size);
+
+    State *state = setupWorkload(chosen);
+    mapRom(state, 0, (chosen->size + PAGE_MASK) & ~PAGE_MASK, program);
+    if (varied) {
+        // registers the program doesn't set itself start out different too
+        state->a = lane * 37;
+        state->d = lane * 11;
+        state->e = lane * 5;
+        for (int i = 0; i < DATA_SIZE; i++) {
+            state->memory[DATA_START + i] += lane * 37;
+        }
+
+        // and a few instructions apart, for the lockstep engine to line up
+        for (int i = 0; i < lane * 3; i++) {
+            Emulate(state);
+        }
+    }
+    return state;
+}
+
+static void setLockstepInputs(State *state, int lane, int frame, int varied) {
+    int coin = varied && frame >= lane * 4 && frame < lane * 4 + 4;
+    setInputPort(state, 1, PORT1_ALWAYS_SET | (coin ? PORT1_CREDIT : 0));
+}
+
+// returns the number of runs that didn't match, or -1 if the ROM failed to
+// load
+static int benchLockstep(const char *romDirectory) {
+    Rom roms[INVADERS_PART_COUNT];
+    uint16_t addresses[INVADERS_PART_COUNT];
+    if (romDirectory != NULL) {
+        if (openRomSet(romDirectory, invadersRomSet, INVADERS_PART_COUNT,
+                       roms) < 0) {
+            return -1;
+        }
+        for (int i = 0; i < INVADERS_PART_COUNT; i++) {
+            addresses[i] = invadersRomSet[i].address;
+        }
+    }
+
+    printf("\nlockstep, %d machines for %d frames, against the threaded "
+           "engine\n",
+           LOCKSTEP_LANES, LOCKSTEP_FRAMES);
+    printf("%-10s %-7s %10s %10s %9s %8s %8s %6s\n", "workload", "data",
+           "threaded", "lockstep", "speedup", "lanes", "vector", "match");
+
+    int workloadCount = sizeof(workloads) / sizeof(workloads[0]);
+    int failures = 0;
+    for (int workload = 0; workload <= workloadCount; workload++) {
+        if (workload == workloadCount && romDirectory == NULL) {
+            break;
+        }
+
+        for (int varied = 0; varied < 2; varied++) {
+            State *threaded[LOCKSTEP_LANES];
+            State *lockstep[LOCKSTEP_LANES];
+            for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                threaded[lane] = setupLockstepMachine(workload, lane, varied,
+                                                      roms, addresses);
+                lockstep[lane] = setupLockstepMachine(workload, lane, varied,
+                                                      roms, addresses);
+            }
+
+            double start = now();
+            for (int frame = 0; frame < LOCKSTEP_FRAMES; frame++) {
+                for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    setLockstepInputs(threaded[lane], lane, frame, varied);
+                    runFrame(threaded[lane], findEngine("threaded"));
+                }
+            }
+            double threadedTime = now() - start;
+
+            LockstepStats stats = {0};
+            start = now();
+            for (int frame = 0; frame < LOCKSTEP_FRAMES; frame++) {
+                for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    setLockstepInputs(lockstep[lane], lane, frame, varied);
+                }
+                runLockstepFrame(lockstep, LOCKSTEP_LANES, &stats);
+            }
+            double lockstepTime = now() - start;
+
+            int match = 1;
+            for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                match &= statesMatch(threaded[lane], lockstep[lane]);
+                freeWorkload(threaded[lane]);
+                freeWorkload(lockstep[lane]);
+            }
+            failures += !match;
+
+            printf("%-10s %-7s %10.1f %10.1f %8.2fx %8.2f %7.1f%% %6s\n",
+                   workload == workloadCount ? "invaders"
+                                             : workloads[workload].name,
+                   varied ? "varied" : "same",
+                   stats.instructions / threadedTime / 1e6,
+                   stats.instructions / lockstepTime / 1e6,
+                   threadedTime / lockstepTime,
+                   (double)stats.instructions / stats.steps,
+                   100.0 * (stats.instructions - stats.scalarInstructions) /
+                       stats.instructions,
+                   match ? "yes" : "NO");
+        }
+    }
+
+    if (romDirectory != NULL) {
+        for (int i = 0; i < INVADERS_PART_COUNT; i++) {
+            closeRom(&roms[i]);
+        }
+    }
+    return failures;
+}
+
+// FORK -- runs attract mode for a while, forks the machine many times and
+// runs the parent and every fork on for the same frames as a machine that
+// was never forked. Every one of them has to end up with the same registers,
+// address space and picture as that machine
+
+#define FORK_FRAMES 600
+#define FORK_CHILDREN 64
+
+// returns 1 if the machines can't be told apart through the memory map
+static int forkMatches(State *left, State *right) {
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        if (readByte(left, address) != readByte(right, address)) {
+            return 0;
+        }
+    }
+    return registersMatch(left, right);
+}
+
+// returns 1 if every machine matches, 0 if not and -1 if the ROM failed to
+// load
+static int benchFork(const char *romDirectory) {
+    static uint8_t expected[SCREEN_WIDTH * SCREEN_HEIGHT];
+    static uint8_t picture[SCREEN_WIDTH * SCREEN_HEIGHT];
+    const Renderer *renderer = bestRenderer();
+
+    Rom parentRoms[INVADERS_PART_COUNT];
+    Rom referenceRoms[INVADERS_PART_COUNT];
+    State *parent = setupAttractMode(romDirectory, parentRoms);
+    if (parent == NULL) {
+        return -1;
+    }
+    State *reference = setupAttractMode(romDirectory, referenceRoms);
+    if (reference == NULL) {
+        closeAttractMode(parent, romDirectory, parentRoms);
+        return -1;
+    }
+
+    for (int frame = 0; frame < FORK_FRAMES; frame++) {
+        runAttractFrame(parent, romDirectory, frame);
+    }
+
+    State *children[FORK_CHILDREN + 1];
+    double start = now();
+    for (int i = 0; i < FORK_CHILDREN; i++) {
+        children[i] = forkStateMachine(parent);
+        if (children[i] == NULL) {
+            return -1;
+        }
+    }
+    double forkTime = now() - start;
+    children[FORK_CHILDREN] = parent;
+
+    for (int frame = 0; frame < 2 * FORK_FRAMES; frame++) {
+        runAttractFrame(reference, romDirectory, frame);
+    }
+    renderer->render(videoRam(reference), expected, 0, SCREEN_WIDTH);
+
+    int ownedPages = 0;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        ownedPages += ownsPage(reference, page);
+    }
+
+    int match = 1;
+    long copiedPages = 0;
+    start = now();
+    for (int i = 0; i <= FORK_CHILDREN; i++) {
+        for (int frame = FORK_FRAMES; frame < 2 * FORK_FRAMES; frame++) {
+            runAttractFrame(children[i], romDirectory, frame);
+        }
+        for (int page = 0; page < PAGE_COUNT; page++) {
+            copiedPages += ownsPage(children[i], page) &&
+                           children[i]->fork->shared[page] == NULL;
+        }
+    }
+    double runTime = now() - start;
+
+    for (int i = 0; i <= FORK_CHILDREN; i++) {
+        renderer->render(videoRam(children[i]), picture, 0, SCREEN_WIDTH);
+        match &= forkMatches(reference, children[i]) &&
+                 memcmp(expected, picture, sizeof(picture)) == 0;
+        if (i < FORK_CHILDREN) {
+            freeWorkload(children[i]);
+        }
+    }
+
+    printf("\nfork of %s attract mode after %d frames, %d forks and the "
+           "parent run %d more\n",
+           romDirectory != NULL ? "space invaders" : "stand in", FORK_FRAMES,
+           FORK_CHILDREN, FORK_FRAMES);
+    printf("%-12s %10s %6s\n", "operation", "us/fork", "match");
+    printf("%-12s %10.2f %6s\n", "fork", forkTime / FORK_CHILDREN * 1e6,
+           "-");
+    printf("%-12s %10.2f %6s\n", "run", runTime / (FORK_CHILDREN + 1) * 1e6,
+           match ? "yes" : "NO");
+    printf("%.1f of %d pages of RAM copied by each machine\n",
+           (double)copiedPages / (FORK_CHILDREN + 1), ownedPages);
+
+    closeAttractMode(parent, romDirectory, parentRoms);
+    closeAttractMode(reference, romDirectory, referenceRoms);
+    return match;
+}
+
+int main(int argc, char **argv) {
+    long cycles = DEFAULT_CYCLES;
+    // the space invaders ROM set, for attract mode
+    const char *romDirectory = NULL;
+    const char *testDirectory = NULL;
+    const char *jsonPath = NULL;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--tests") == 0 && i + 1 < argc) {
+            testDirectory = argv[++i];
+        } else if (positional == 0) {
+            cycles = atol(argv[i]);
+            positional++;
+        } else if (positional == 1) {
+            romDirectory = argv[i];
+            positional++;
+        } else {
+            cycles = 0;
+        }
+    }
+    if (cycles <= 0) {
+        fprintf(stderr,
+                "Usage: %s [--json file] [--tests dir] [cycles] [romdir]\n",
+                argv[0]);
+        return 1;
+    }
+
+#ifdef EMULATOR_COMPUTED_GOTO
+    const char *threadedKind = "computed goto";
+#else
+    const char *threadedKind = "handler table";
+#endif
+    generateRandomProgram();
+
+    if (jsonPath != NULL) {
+        json = fopen(jsonPath, "w");
+        if (json == NULL) {
+            perror(jsonPath);
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "{\n  \"cycles\": %ld,\n  \"threaded\": \"%s\",\n"
+                      "  \"results\": [",
+                cycles, threadedKind);
+    }
+
+    printf("%ld cycles per run, threaded engines use %s\n", cycles,
+           threadedKind);
+    printf("every engine is checked against the switch engine, which is "
+           "listed first\n\n");
+    printf("%-12s %-10s %10s %10s %9s %9s %6s\n", "workload", "engine",
+           "MIPS", "MHz", "ns/inst", "speedup", "match");
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        EngineRun run = {workloads[i].name, setupSynthetic, runCycles,
+                         &workloads[i]};
+        failures += benchEngines(&run, cycles);
+    }
+
+    Rom roms[INVADERS_PART_COUNT];
+    if (romDirectory != NULL) {
+        if (openRomSet(romDirectory, invadersRomSet, INVADERS_PART_COUNT,
+                       roms) < 0) {
+            return EXIT_FAILURE;
+        }
+        EngineRun run = {"attract", setupAttract, runFrames, roms};
+        failures += benchEngines(&run, cycles);
+        for (int i = 0; i < INVADERS_PART_COUNT; i++) {
+            closeRom(&roms[i]);
+        }
+    }
+
+    // the test programs that aren't in the directory are left out
+    for (int i = 0; testDirectory != NULL && i < CPM_TEST_PROGRAM_COUNT;
+         i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", testDirectory,
+                 cpmTestPrograms[i]);
+        if (access(path, R_OK) == 0) {
+            EngineRun run = {cpmTestPrograms[i], setupTestProgram,
+                             runTestProgram, path};
+            failures += benchEngines(&run, cycles);
+        }
+    }
+
+    if (json != NULL) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+        json = NULL;
+    }
+
+    failures += benchTrace(cycles);
+    failures += benchRenderers();
+
+    int match = benchDirtyColumns(romDirectory);
+    if (match < 0) {
+        return EXIT_FAILURE;
+    }
+    failures += !match;
+
+    match = benchRewind(romDirectory);
+    if (match < 0) {
+        return EXIT_FAILURE;
+    }
+    failures += !match;
+
+    match = benchBatch(romDirectory);
+    if (match < 0) {
+        return EXIT_FAILURE;
+    }
+    failures += !match;
+
+    int lockstepFailures = benchLockstep(romDirectory);
+    if (lockstepFailures < 0) {
+        return EXIT_FAILURE;
+    }
+    failures += lockstepFailures;
+
+    match = benchFork(romDirectory);
+    if (match < 0) {
+        return EXIT_FAILURE;
+    }
+    failures += !match;
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
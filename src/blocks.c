@@ -0,0 +1,192 @@
+#include "blocks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jit.h"
+#include "memory.h"
+
+const uint8_t instructionLength[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 0x00
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 0x10
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 0x20
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 0x30
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x90
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xa0
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xb0
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1, // 0xc0
+    1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 1, 2, 1, // 0xd0
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, // 0xe0
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, // 0xf0
+};
+
+// returns 1 for the instructions that can leave the pc anywhere other than
+// the next instruction, which always end a block
+static int endsBlock(uint8_t opcode) {
+    switch (opcode) {
+    case 0x76: // HLT
+    case 0xc3: // JMP
+    case 0xc9: // RET
+    case 0xcd: // CALL
+    case 0xe9: // PCHL
+        return 1;
+    }
+
+    // the conditional returns, jumps and calls and the RSTs are the opcodes
+    // from 0xc0 up with 0, 2, 4 or 7 in the low three bits
+    int low = opcode & 0x07;
+    return opcode >= 0xc0 && (low == 0 || low == 2 || low == 4 || low == 7);
+}
+
+BlockCache *blockCache(State *state) {
+    if (state->blockCache == NULL) {
+        state->blockCache = calloc(1, sizeof(BlockCache));
+        if (state->blockCache == NULL) {
+            perror("Failed to allocate the block cache");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return state->blockCache;
+}
+
+void freeBlockCache(State *state) {
+    if (state->blockCache != NULL) {
+        flushBlockCache(state);
+        freeJitArena(state->blockCache);
+        free(state->blockCache);
+        state->blockCache = NULL;
+    }
+}
+
+// the bit of codeBytes that covers the byte at address
+static int codeBit(BlockCache *cache, uint16_t address) {
+    return (cache->codePage[address >> PAGE_SHIFT] << PAGE_SHIFT) |
+           (address & PAGE_MASK);
+}
+
+// writes to a page of cached code end up here. The write goes where it went
+// before the page was trapped, and only changing a byte of code flushes
+static void writeCode(State *state, uint16_t address, uint8_t value) {
+    BlockCache *cache = state->blockCache;
+    int page = address >> PAGE_SHIFT;
+    int bit = codeBit(cache, address);
+    int changesCode = (cache->codeBytes[bit >> 3] & (1 << (bit & 7))) &&
+                      readByte(state, address) != value;
+
+    if (cache->savedWritePages[page] != NULL) {
+        cache->savedWritePages[page][address & PAGE_MASK] = value;
+    } else {
+        cache->savedWriteHandlers[page](state, address, value);
+    }
+
+    if (changesCode) {
+        flushBlockCache(state);
+    }
+}
+
+// traps writes to the page and to every page that mirrors it. ROM pages are
+// left alone, as nothing can change them
+static void trapPage(State *state, int page) {
+    BlockCache *cache = state->blockCache;
+    if (cache->trapped[page] ||
+        state->writePages[page] == state->discardPage) {
+        return;
+    }
+
+    for (int mirror = 0; mirror < PAGE_COUNT; mirror++) {
+        if (state->readPages[mirror] != state->readPages[page] ||
+            cache->trapped[mirror]) {
+            continue;
+        }
+        cache->trapped[mirror] = 1;
+        cache->codePage[mirror] = page;
+        cache->savedWritePages[mirror] = state->writePages[mirror];
+        cache->savedWriteHandlers[mirror] = state->writeHandlers[mirror];
+        state->writePages[mirror] = NULL;
+        state->writeHandlers[mirror] = writeCode;
+    }
+}
+
+static void markCode(State *state, uint16_t address) {
+    BlockCache *cache = state->blockCache;
+    trapPage(state, address >> PAGE_SHIFT);
+    int bit = codeBit(cache, address);
+    cache->codeBytes[bit >> 3] |= 1 << (bit & 7);
+}
+
+Block *translateBlock(State *state, uint16_t address) {
+    BlockCache *cache = blockCache(state);
+    size_t largest = sizeof(Block) + MAX_BLOCK_INSTRUCTIONS * sizeof(MicroOp);
+    if (cache->used + largest > BLOCK_ARENA_SIZE) {
+        flushBlockCache(state);
+    }
+
+    Block *block = (Block *)(cache->arena + cache->used);
+    block->native = NULL;
+    block->hits = 0;
+    block->start = address;
+    block->count = 0;
+    block->cycles = 0;
+
+    uint16_t pc = address;
+    while (block->count < MAX_BLOCK_INSTRUCTIONS) {
+        uint8_t opcode = readByte(state, pc);
+        int length = instructionLength[opcode];
+        MicroOp *op = &block->ops[block->count++];
+
+        op->opcode = opcode;
+        op->operand = 0;
+        if (length == 2) {
+            op->operand = readByte(state, (uint16_t)(pc + 1));
+        } else if (length == 3) {
+            op->operand = readByte(state, (uint16_t)(pc + 1)) |
+                          (readByte(state, (uint16_t)(pc + 2)) << 8);
+        }
+
+        block->cycles += cycleTable[opcode];
+        if (endsBlock(opcode)) {
+            block->cycles += CONDITIONAL_TAKEN_CYCLES;
+        }
+
+        for (int i = 0; i < length; i++) {
+            markCode(state, (uint16_t)(pc + i));
+        }
+        pc += length;
+
+        if (endsBlock(opcode)) {
+            break;
+        }
+    }
+
+    // keeps the next block aligned
+    size_t size = sizeof(Block) + block->count * sizeof(MicroOp);
+    cache->used += (size + _Alignof(Block) - 1) & ~(_Alignof(Block) - 1);
+    cache->blockAt[address] = block;
+    cache->translations++;
+    return block;
+}
+
+void flushBlockCache(State *state) {
+    BlockCache *cache = state->blockCache;
+
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (cache->trapped[page]) {
+            state->writePages[page] = cache->savedWritePages[page];
+            state->writeHandlers[page] = cache->savedWriteHandlers[page];
+            cache->trapped[page] = 0;
+        }
+    }
+
+    memset(cache->blockAt, 0, sizeof(cache->blockAt));
+    memset(cache->codeBytes, 0, sizeof(cache->codeBytes));
+    cache->used = 0;
+    cache->jitUsed = 0;
+    cache->flushed = 1;
+    cache->flushes++;
+}
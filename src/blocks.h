@@ -0,0 +1,79 @@
+#ifndef BLOCKS_H
+#define BLOCKS_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+// BLOCK CACHE -- the block engine decodes the code starting at an address
+// once, up to the first instruction that can jump, into a block of micro-ops
+// with the immediates already read. Blocks are looked up by the address they
+// start at. Pages holding cached code have their writes trapped, and a write
+// that changes a byte of cached code flushes the whole cache, which only
+// happens with self modifying code. The cache has to be flushed by hand when
+// the memory map changes under it
+
+// longest run of instructions decoded into one block
+#define MAX_BLOCK_INSTRUCTIONS 64
+
+// bytes of micro-ops the cache holds before it is flushed to make room
+#define BLOCK_ARENA_SIZE (1 << 20)
+
+// one decoded instruction
+typedef struct MicroOp {
+    uint8_t opcode;
+    uint16_t operand; // the byte or word after the opcode, if it has one
+} MicroOp;
+
+// compiled code of a block, see jit.h. Returns 0 when it ran the whole block,
+// and 1 when it stopped at an instruction the interpreter has to run
+typedef int (*NativeBlock)(State *state);
+
+typedef struct Block {
+    NativeBlock native;
+    uint32_t hits; // times the jit engine has run the block
+    uint16_t start;
+    uint16_t count;
+    uint16_t cycles; // most cycles the block can take
+    MicroOp ops[];
+} Block;
+
+struct BlockCache {
+    Block *blockAt[MEMORY_SIZE]; // the block starting at each address
+
+    // one bit for each byte of cached code. Pages that mirror each other
+    // share the bits of the first of them that held code
+    uint8_t codeBytes[MEMORY_SIZE / 8];
+    uint8_t codePage[PAGE_COUNT];
+
+    // how the trapped pages were written to before they were trapped
+    uint8_t trapped[PAGE_COUNT];
+    uint8_t *savedWritePages[PAGE_COUNT];
+    WriteHandler savedWriteHandlers[PAGE_COUNT];
+
+    int flushed; // set by a flush, so the block that caused it stops
+    uint64_t translations;
+    uint64_t flushes;
+
+    // compiled code of the jit engine, mapped the first time it is needed
+    uint8_t *jitArena;
+    size_t jitUsed;
+
+    size_t used;
+    uint8_t arena[BLOCK_ARENA_SIZE];
+};
+
+// number of bytes each instruction takes up, the opcode included
+extern const uint8_t instructionLength[256];
+
+// returns the block cache of the state, and creates it the first time
+BlockCache *blockCache(State *state);
+void freeBlockCache(State *state);
+
+// decodes the block starting at address and adds it to the cache
+Block *translateBlock(State *state, uint16_t address);
+
+// throws every block away and gives the trapped pages back their old writes
+void flushBlockCache(State *state);
+
+#endif
@@ -0,0 +1,80 @@
+#include "cpm.h"
+
+#include <stdio.h>
+
+#include "memory.h"
+#include "ports.h"
+
+const char *const cpmTestPrograms[CPM_TEST_PROGRAM_COUNT] = {
+    "TST8080.COM", "cpudiag.bin", "8080PRE.COM", "CPUTEST.COM", "8080EXM.COM",
+};
+
+static void printBdos(State *state, uint8_t port, uint8_t value) {
+    (void)port;
+    (void)value;
+    if (state->c == 2) {
+        fputc(state->e, state->console);
+    } else if (state->c == 9) {
+        // a string with no '$' would print forever, so it stops once it has
+        // gone all the way round memory and says so on the console, which
+        // fails the run
+        uint16_t start = (state->d << 8) | state->e;
+        uint32_t length = 0;
+        while (length < MEMORY_SIZE &&
+               readByte(state, (uint16_t)(start + length)) != '$') {
+            fputc(readByte(state, (uint16_t)(start + length)), state->console);
+            length++;
+        }
+        if (length == MEMORY_SIZE) {
+            fprintf(state->console,
+                    "\nBDOS error: no '$' after the string at %04x\n", start);
+        }
+    }
+    fflush(state->console);
+}
+
+int loadCpmProgram(State *state, const char *filename, FILE *console) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    // the program can use everything up to the BDOS
+    size_t room = CPM_BDOS_ENTRY - CPM_PROGRAM_START;
+    size_t size = fread(state->memory + CPM_PROGRAM_START, 1, room, file);
+    int tooLarge = fgetc(file) != EOF;
+    fclose(file);
+    if (size == 0 || tooLarge) {
+        fprintf(stderr, "Failed to load CP/M program %s\n", filename);
+        return -1;
+    }
+    mapFlatMemory(state);
+
+    // JMP CPM_WARM_BOOT at 0 and JMP CPM_BDOS_ENTRY at 5
+    static const uint8_t zeroPage[] = {
+        0xc3, CPM_WARM_BOOT & 0xff, CPM_WARM_BOOT >> 8, 0x00, 0x00,
+        0xc3, CPM_BDOS_ENTRY & 0xff, CPM_BDOS_ENTRY >> 8,
+    };
+    // OUT CPM_BDOS_PORT, RET, then JMP to itself for the warm boot
+    static const uint8_t bdos[] = {
+        0xd3, CPM_BDOS_PORT, 0xc9, 0xc3, CPM_WARM_BOOT & 0xff,
+        CPM_WARM_BOOT >> 8,
+    };
+    for (size_t i = 0; i < sizeof(zeroPage); i++) {
+        writeByte(state, i, zeroPage[i]);
+    }
+    for (size_t i = 0; i < sizeof(bdos); i++) {
+        writeByte(state, CPM_BDOS_ENTRY + i, bdos[i]);
+    }
+    state->console = console;
+    mapPort(state, CPM_BDOS_PORT, NULL, console != NULL ? printBdos : NULL);
+
+    state->sp = CPM_BDOS_ENTRY;
+    state->pc = CPM_PROGRAM_START;
+    return 0;
+}
+
+int cpmFinished(State *state) {
+    return state->pc == CPM_WARM_BOOT;
+}
@@ -0,0 +1,34 @@
+#ifndef CPM_H
+#define CPM_H
+
+#include <stdio.h>
+
+#include "cpu.h"
+
+// CP/M -- just enough of CP/M to run the 8080 test programs, which are CP/M
+// programs loaded at CPM_PROGRAM_START. CALL 5 jumps to a BDOS at
+// CPM_BDOS_ENTRY that hands the call to a port, where BDOS function 2 prints
+// the character in E and function 9 the string at DE up to a '$'. A string
+// with no '$' in all 64KB prints a BDOS error instead of hanging. The word
+// at 6 holds CPM_BDOS_ENTRY as it does in CP/M, and the programs set their
+// stack from it. A program finishes by jumping to 0, the warm boot, which
+// leaves the cpu spinning at CPM_WARM_BOOT
+#define CPM_PROGRAM_START 0x0100
+#define CPM_BDOS_ENTRY 0xff00
+#define CPM_WARM_BOOT 0xff03
+#define CPM_BDOS_PORT 0xff
+
+// the standard test programs, in order of how long they take to run
+#define CPM_TEST_PROGRAM_COUNT 5
+extern const char *const cpmTestPrograms[CPM_TEST_PROGRAM_COUNT];
+
+// loads the program in the file into a flat memory machine along with the
+// BDOS, and points pc at it. The output is written to console, which is kept
+// on the machine, or thrown away when console is NULL. Returns 0 on success
+// and -1 on failure
+int loadCpmProgram(State *state, const char *filename, FILE *console);
+
+// returns 1 once the program has jumped to the warm boot
+int cpmFinished(State *state);
+
+#endif
@@ -0,0 +1,1097 @@
+#include "cpu.h"
+#include "blocks.h"
+#include "fork.h"
+#include "jit.h"
+#include "memory.h"
+#include "ports.h"
+#include "profile.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+State *setupStateMachine() {
+
+    // This allocates the memory for the state
+    State *state = malloc(sizeof(State));
+    if (state == NULL) {
+        perror("Failed to allocate memory of the CPU");
+        exit(EXIT_FAILURE);
+    }
+    memset(state, 0, sizeof(State)); // fills the state machine with zeroes
+
+    // Allocates memory for the emulated systems memory
+    state->memory = malloc(MEMORY_SIZE); // 64KB of memory
+    if (state->memory == NULL) {
+        perror("Failed to allocate memory for emulated system");
+        free(state);
+        exit(EXIT_FAILURE);
+    }
+    memset(state->memory, 0, MEMORY_SIZE); // clears all 64KB of memory
+    mapFlatMemory(state);
+    clearPorts(state);
+
+    // Initialise the flags with 0, apart from the bit that is always set
+    state->flags = PSW_FIXED_BITS;
+
+    // Initialise the registers and state variables with 0
+    state->a = 0;
+    state->b = 0;
+    state->c = 0;
+    state->d = 0;
+    state->e = 0;
+    state->h = 0;
+    state->l = 0;
+    state->sp = 0;
+    state->pc = 0;
+
+    return state;
+}
+
+void freeStateMachine(State *state) {
+    freeBlockCache(state);
+    freeFork(state);
+    free(state->memory);
+    free(state);
+}
+
+void outputStateValues(State *state) {
+    /* print out processor state */
+    printf("\tC=%d,P=%d,S=%d,Z=%d\n", isFlagSet(state, CY_FLAG),
+           isFlagSet(state, P_FLAG), isFlagSet(state, S_FLAG),
+           isFlagSet(state, Z_FLAG));
+    printf(
+        "\tA $%02x B $%02x C $%02x D $%02x E $%02x H $%02x L $%02x SP %04x\n",
+        state->a, state->b, state->c, state->d, state->e, state->h, state->l,
+        state->sp);
+}
+
+// this is for any instruction that we have not yet implemented
+void UnimplementedInstruction(State *state, uint8_t opcode) {
+    // Error messages
+    fprintf(stderr, "Error: Unimplemented instruction 0x%02x encountered\n",
+            opcode);
+    fprintf(stderr, "Program counter: %x\n", state->pc);
+    outputStateValues(state);
+
+    // Terminates the execution
+    exit(EXIT_FAILURE);
+}
+
+// FLAG TABLES -- precomputed so that setting the flags is a table load instead
+// of testing the result bit by bit
+
+// zero, sign and parity flags of every byte, in the same bit positions as the
+// PSW
+static const uint8_t zspTable[256] = {
+    0x44, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, // 0x00
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, // 0x08
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, // 0x10
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, // 0x18
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, // 0x20
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, // 0x28
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, // 0x30
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, // 0x38
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, // 0x40
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, // 0x48
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, // 0x50
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, // 0x58
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, // 0x60
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, // 0x68
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, // 0x70
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, // 0x78
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, // 0x80
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, // 0x88
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, // 0x90
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, // 0x98
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, // 0xa0
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, // 0xa8
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, // 0xb0
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, // 0xb8
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, // 0xc0
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, // 0xc8
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, // 0xd0
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, // 0xd8
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, // 0xe0
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, // 0xe8
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, // 0xf0
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, // 0xf8
+};
+
+// aux carry out of bit 3, indexed by bit 3 of the accumulator, the operand and
+// the result (see auxCarryIndex). Subtraction adds the complement of the
+// operand, so it has its own table
+static const uint8_t addAuxCarryTable[8] = {
+    0, 0, AC_FLAG, 0, AC_FLAG, 0, AC_FLAG, AC_FLAG,
+};
+static const uint8_t subAuxCarryTable[8] = {
+    AC_FLAG, 0, 0, 0, AC_FLAG, AC_FLAG, AC_FLAG, 0,
+};
+
+// CHECK FLAGS -- Checks certain values for the flags
+
+// returns 1 if there is even parity and 0 if there is odd parity.
+uint8_t checkParity(uint8_t value) { return (zspTable[value] & P_FLAG) != 0; }
+
+uint8_t auxCarryIndex(uint8_t accumulator, uint8_t value, uint8_t result) {
+    return ((accumulator & 0x08) >> 1) | ((value & 0x08) >> 2) |
+           ((result & 0x08) >> 3);
+}
+
+// LAZY FLAGS -- operations that the lazy engine has not worked out the flags
+// for yet. The engine stores the operation in lazyOp, the accumulator and
+// operand in lazyAccumulator and lazyValue, and the 16 bit result in lazyResult
+
+#define LAZY_NONE 0
+#define LAZY_ADD 1   // add and adc
+#define LAZY_SUB 2   // sub, sbb and cmp
+#define LAZY_AND 3   // ana
+#define LAZY_LOGIC 4 // ora and xra, which clear the carry and aux carry
+#define LAZY_INR 5   // inr and dcr keep the carry that is already in flags
+#define LAZY_DCR 6
+
+// returns the carry of the pending operation without working out the rest
+uint8_t lazyCarry(State *state) {
+    switch (state->lazyOp) {
+    case LAZY_ADD:
+    case LAZY_SUB:
+        return (state->lazyResult >> 8) & CY_FLAG;
+    case LAZY_AND:
+    case LAZY_LOGIC:
+        return 0;
+    default:
+        return state->flags & CY_FLAG;
+    }
+}
+
+// works out the flags of the pending operation and stores them in flags
+void materializeFlags(State *state) {
+    if (state->lazyOp == LAZY_NONE) {
+        return;
+    }
+
+    uint8_t result = (uint8_t)state->lazyResult;
+    uint8_t index = auxCarryIndex(state->lazyAccumulator, state->lazyValue,
+                                  result);
+    uint8_t flags = zspTable[result] | PSW_FIXED_BITS;
+
+    switch (state->lazyOp) {
+    case LAZY_ADD:
+        flags |= addAuxCarryTable[index] | ((state->lazyResult >> 8) & CY_FLAG);
+        break;
+    case LAZY_SUB:
+        flags |= subAuxCarryTable[index] | ((state->lazyResult >> 8) & CY_FLAG);
+        break;
+    case LAZY_AND:
+        flags |= ((state->lazyAccumulator | state->lazyValue) & 0x08) << 1;
+        break;
+    case LAZY_LOGIC:
+        break;
+    case LAZY_INR:
+        flags |= (state->flags & CY_FLAG) |
+                 ((result & 0x0f) == 0x00 ? AC_FLAG : 0);
+        break;
+    case LAZY_DCR:
+        flags |= (state->flags & CY_FLAG) |
+                 ((result & 0x0f) != 0x0f ? AC_FLAG : 0);
+        break;
+    }
+
+    state->flags = flags;
+    state->lazyOp = LAZY_NONE;
+}
+
+// CHECK FLAGS -- function to set the flags for different groups of opcodes
+
+// the flag accessors work out any pending lazy flags first, so they give the
+// right answer for every engine. lazyOp is always LAZY_NONE outside of the lazy
+// engine
+
+uint8_t isFlagSet(State *state, uint8_t flag) {
+    if (state->lazyOp != LAZY_NONE) {
+        materializeFlags(state);
+    }
+    return (state->flags & flag) != 0;
+}
+
+// sets or clears a single flag
+void setFlag(State *state, uint8_t flag, uint8_t value) {
+    if (state->lazyOp != LAZY_NONE) {
+        materializeFlags(state);
+    }
+    state->flags = value ? (state->flags | flag) : (state->flags & ~flag);
+}
+
+// sets the zero, sign and parity flags of a result, keeping the carry and aux
+// carry flags
+void setZSPFlags(State *state, uint8_t value) {
+    state->flags = (state->flags & (CY_FLAG | AC_FLAG)) | zspTable[value] |
+                   PSW_FIXED_BITS;
+}
+
+// sets all the flags for an addition or subtraction of value from the
+// accumulator. The carry is bit 8 of the 16 bit result, which for a
+// subtraction is also the borrow because the result wraps
+void setArithmeticFlags(State *state, uint8_t value, uint16_t result,
+                        uint8_t isSubtraction) {
+    uint8_t index = auxCarryIndex(state->a, value, (uint8_t)result);
+    uint8_t auxCarry =
+        isSubtraction ? subAuxCarryTable[index] : addAuxCarryTable[index];
+
+    state->flags = zspTable[(uint8_t)result] | auxCarry |
+                   ((result >> 8) & CY_FLAG) | PSW_FIXED_BITS;
+}
+
+// SET AND GET FLAGS
+
+// the flags are already stored in the PSW layout, so these are plain moves
+
+uint8_t getFlags(State *state) {
+    if (state->lazyOp != LAZY_NONE) {
+        materializeFlags(state);
+    }
+    return state->flags;
+}
+
+// replaces every flag, so anything still pending is thrown away
+void setFlags(State *state, uint8_t flags) {
+    state->lazyOp = LAZY_NONE;
+    state->flags = (flags & PSW_FLAGS) | PSW_FIXED_BITS;
+}
+
+// MAKE WORD -- This section is anything relating to the creation of a word (2
+// bytes) from byte pairs
+
+// will make a 16 bit word
+uint16_t combineBytesToWord(uint8_t highByte, uint8_t lowByte) {
+    return (highByte << 8) | lowByte;
+}
+
+// BREAK WORD -- Breaking the 2 byte word into a pair of bytes
+
+void splitWordToBytes(uint8_t *highByte, uint8_t *lowByte, uint16_t word) {
+    *highByte = (word >> 8);
+    *lowByte = word & 0xff;
+}
+
+uint8_t getHighByte(uint16_t value) { return (value >> 8) & 0xff; }
+
+uint8_t getLowByte(uint16_t value) { return value & 0xff; }
+
+// loading memory
+void loadMemory(State *state, uint8_t *memory) {
+    memcpy(state->memory, memory, MEMORY_SIZE);
+}
+
+// getters and setters for register pairs
+
+// breaks the 16 bit value in half and assigns each half to the register pair
+// respectfully
+void writeRegPairFromWord(State *state, uint8_t *highByte, uint8_t *lowByte,
+                          uint16_t value) {
+    (void)state;
+    *highByte = (value >> 8) &
+                0xff; // the 0xff is redundant, but keeping it for clarity
+    *lowByte = value & 0xff;
+}
+
+void writeDirectFromWord(State *state, uint16_t *index, uint16_t value) {
+    (void)state;
+    *index = value;
+}
+
+// adds values in two registers together and returns the 32 bit value, so
+// bit 16 is the carry out of the pair
+uint32_t addToRegPair(State *state, uint8_t *highByte, uint8_t *lowByte,
+                      uint16_t value) {
+    uint16_t twoByteWord = combineBytesToWord(*highByte, *lowByte);
+    uint32_t result = (uint32_t)twoByteWord + value;
+
+    writeRegPairFromWord(state, highByte, lowByte, (uint16_t)result);
+    return result;
+}
+
+// ARITHMETIC GROUP -- instructions for the arithmetic values in the isa
+
+// ARITHMETHIC methods
+
+void add(State *state, uint8_t value) {
+    uint16_t data = (state->a) + value;
+    setArithmeticFlags(state, value, data, 0);
+    state->a = (uint8_t)data;
+}
+
+void adc(State *state, uint8_t value) {
+    uint16_t data = (state->a) + value + (state->flags & CY_FLAG);
+    setArithmeticFlags(state, value, data, 0);
+    state->a = (uint8_t)data;
+}
+
+void sub(State *state, uint8_t value) {
+    uint16_t data = (state->a) - value;
+    setArithmeticFlags(state, value, data, 1);
+    state->a = (uint8_t)data;
+}
+
+void sbb(State *state, uint8_t value) {
+    uint16_t data = (state->a) - value - (state->flags & CY_FLAG);
+    setArithmeticFlags(state, value, data, 1);
+    state->a = (uint8_t)data;
+}
+
+void cmp(State *state, uint8_t value) {
+    uint16_t data = (state->a) - value;
+    setArithmeticFlags(state, value, data, 1);
+}
+
+// decimal adjust, turns the sum of two packed BCD numbers back into packed
+// BCD. 6 is added to each digit that went past 9 or carried out, and the
+// carry is only ever set by it, never cleared
+void daa(State *state) {
+    uint8_t correction = 0;
+    uint8_t carry = isFlagSet(state, CY_FLAG);
+    if ((state->a & 0x0f) > 9 || isFlagSet(state, AC_FLAG)) {
+        correction |= 0x06;
+    }
+    if (state->a > 0x99 || carry) {
+        correction |= 0x60;
+        carry = 1;
+    }
+
+    uint16_t data = state->a + correction;
+    setArithmeticFlags(state, correction, data, 0);
+    setFlag(state, CY_FLAG, carry);
+    state->a = (uint8_t)data;
+}
+
+// LOGICAL methods
+
+void ana(State *state, uint8_t value) {
+    uint8_t data = (state->a) & value;
+    // logical methods clear the carry flag, and the 8080 sets the aux carry to
+    // the OR of bit 3 of both operands
+    state->flags = zspTable[data] | (((state->a | value) & 0x08) << 1) |
+                   PSW_FIXED_BITS;
+    state->a = data;
+}
+
+void ora(State *state, uint8_t value) {
+    uint8_t data = (state->a) | value;
+    state->flags = zspTable[data] | PSW_FIXED_BITS;
+    state->a = data;
+}
+
+void xra(State *state, uint8_t value) {
+    uint8_t data = (state->a) ^ value;
+    state->flags = zspTable[data] | PSW_FIXED_BITS;
+    state->a = data;
+}
+
+// Joins to 8 bit words, increments it and then splits it up again
+// it is fine if the value overflows, this is expected behaviour.
+void inxRegPair(State *state, uint8_t *highByte, uint8_t *lowByte) {
+    uint16_t word = combineBytesToWord(*highByte, *lowByte);
+    word++;
+    writeRegPairFromWord(state, highByte, lowByte, word);
+}
+
+// increments the 16 bit word
+void inx(State *state, uint16_t *value) {
+    (void)state;
+    (*value)++;
+}
+
+// increment and decrement leave the carry flag alone
+void inr(State *state, uint8_t *value) {
+    uint8_t result = *value + 1;
+    setZSPFlags(state, result);
+    setFlag(state, AC_FLAG, (result & 0x0f) == 0x00);
+    *value = result; // discards the first 8 bits
+}
+
+// Joins to 8 bit words, decrements it and then splits it up again
+// it is fine if the value overflows, this is expected behaviour.
+void dcxRegPair(State *state, uint8_t *highByte, uint8_t *lowByte) {
+    uint16_t word = combineBytesToWord(*highByte, *lowByte);
+    word--;
+    writeRegPairFromWord(state, highByte, lowByte, word);
+}
+
+// decrements the 16 bit word
+void dcx(State *state, uint16_t *value) {
+    (void)state;
+    (*value)--;
+}
+
+void dcr(State *state, uint8_t *value) {
+    uint8_t result = *value - 1;
+    setZSPFlags(state, result);
+    setFlag(state, AC_FLAG, (result & 0x0f) != 0x0f);
+    *value = result; // discards the first 8 bits
+};
+
+// LAZY ARITHMETHIC methods -- used by the lazy engine in place of the methods
+// above. They do the same work on the registers but only record what is
+// needed to work out the flags later
+
+void recordLazyFlags(State *state, uint8_t op, uint8_t value,
+                     uint16_t result) {
+    state->lazyOp = op;
+    state->lazyAccumulator = state->a;
+    state->lazyValue = value;
+    state->lazyResult = result;
+}
+
+void lazyAdd(State *state, uint8_t value) {
+    uint16_t data = (state->a) + value;
+    recordLazyFlags(state, LAZY_ADD, value, data);
+    state->a = (uint8_t)data;
+}
+
+void lazyAdc(State *state, uint8_t value) {
+    uint16_t data = (state->a) + value + lazyCarry(state);
+    recordLazyFlags(state, LAZY_ADD, value, data);
+    state->a = (uint8_t)data;
+}
+
+void lazySub(State *state, uint8_t value) {
+    uint16_t data = (state->a) - value;
+    recordLazyFlags(state, LAZY_SUB, value, data);
+    state->a = (uint8_t)data;
+}
+
+void lazySbb(State *state, uint8_t value) {
+    uint16_t data = (state->a) - value - lazyCarry(state);
+    recordLazyFlags(state, LAZY_SUB, value, data);
+    state->a = (uint8_t)data;
+}
+
+void lazyCmp(State *state, uint8_t value) {
+    uint16_t data = (state->a) - value;
+    recordLazyFlags(state, LAZY_SUB, value, data);
+}
+
+void lazyAna(State *state, uint8_t value) {
+    uint8_t data = (state->a) & value;
+    recordLazyFlags(state, LAZY_AND, value, data);
+    state->a = data;
+}
+
+void lazyOra(State *state, uint8_t value) {
+    uint8_t data = (state->a) | value;
+    recordLazyFlags(state, LAZY_LOGIC, value, data);
+    state->a = data;
+}
+
+void lazyXra(State *state, uint8_t value) {
+    uint8_t data = (state->a) ^ value;
+    recordLazyFlags(state, LAZY_LOGIC, value, data);
+    state->a = data;
+}
+
+// the carry of any pending operation is moved into flags first, since
+// increment and decrement keep it
+void lazyInr(State *state, uint8_t *value) {
+    uint8_t result = *value + 1;
+    state->flags = (state->flags & ~CY_FLAG) | lazyCarry(state);
+    recordLazyFlags(state, LAZY_INR, *value, result);
+    *value = result;
+}
+
+void lazyDcr(State *state, uint8_t *value) {
+    uint8_t result = *value - 1;
+    state->flags = (state->flags & ~CY_FLAG) | lazyCarry(state);
+    recordLazyFlags(state, LAZY_DCR, *value, result);
+    *value = result;
+}
+
+// dad opcode takes word and then adds them to register h and l
+void dad(State *state, uint16_t value) {
+    uint32_t result = addToRegPair(state, &state->h, &state->l, value);
+    setFlag(state, CY_FLAG, (result >> 16) & 1);
+}
+
+// dadRegPair opcode that joins two bytes and then adds them to register h and l
+void dadRegPair(State *state, uint8_t *highByte, uint8_t *lowByte) {
+    uint16_t value = combineBytesToWord(*highByte, *lowByte);
+    dad(state, value);
+}
+
+// loads a 16 bit value into a register pair
+void lxiRegPair(State *state, uint8_t *highByte, uint8_t *lowByte,
+                uint16_t value) {
+    writeRegPairFromWord(state, highByte, lowByte, value);
+}
+
+// loads a 16 bit value into a register pair
+void lxi(State *state, uint16_t *index, uint16_t value) {
+    writeDirectFromWord(state, index, value);
+}
+
+void lhld(State *state, uint16_t address) {
+    // stores the data in the address to register l
+    state->l = readByte(state, address);
+    // stores the data in the address + 1 to register h
+    state->h = readByte(state, address + 1);
+}
+
+void mov(State *state, uint8_t *dest, uint8_t src) {
+    (void)state;
+    *dest = src;
+}
+
+// STACK INSTRUCTIONS
+
+// stack arithmethic function
+// incremnetValue can be positive or negative
+void stackArithmetic(State *state, uint16_t incrementValue) {
+    state->sp += incrementValue;
+    // Apparently the hardware just wraps addresses, so we don't need the whole
+    // wrap stuff
+    /*
+    if (state -> sp > STACK_TOP) {
+        printf("Stack overflow error: %d", state -> sp);
+        exit(EXIT_FAILURE);
+    }
+    else if (state -> sp < STACK_BOTTOM) {
+        printf("Stack underflow error: %d", state -> sp);
+        exit(EXIT_FAILURE);
+    }
+    */
+}
+
+// takes stack pointer and stores them into a register pair
+void popIntoRegPair(State *state, uint8_t *highByte, uint8_t *lowByte) {
+    *lowByte = readByteAtSP(state);
+    stackArithmetic(state, 1);
+    *highByte = readByteAtSP(state);
+    stackArithmetic(state, 1);
+}
+
+// takes stack pointer and stores them into a register pair
+uint8_t pop(State *state, uint16_t *value) {
+    uint8_t low = readByteAtSP(state);
+    uint8_t high = readByte(state, state->sp + 1);
+    *value = combineBytesToWord(high, low);
+    stackArithmetic(state, 2);
+    return 0;
+}
+
+// pushes register pair onto the stack
+void pushIntoRegPair(State *state, uint8_t *highByte, uint8_t *lowByte) {
+    stackArithmetic(state, -2);
+    writeByte(state, state->sp + 1, *highByte);
+    writeByteAtSP(state, *lowByte);
+}
+
+void push(State *state, uint16_t value) {
+    stackArithmetic(state, -2);
+    writeByte(state, state->sp + 1, getHighByte(value));
+    writeByteAtSP(state, getLowByte(value));
+}
+
+// CYCLES -- number of clock cycles each instruction takes
+
+const uint8_t cycleTable[256] = {
+    4,  10, 7,  5,  5,  5,  7,  4,  4,  10, 7,  5,  5,  5,  7, 4,  // 0x00
+    4,  10, 7,  5,  5,  5,  7,  4,  4,  10, 7,  5,  5,  5,  7, 4,  // 0x10
+    4,  10, 16, 5,  5,  5,  7,  4,  4,  10, 16, 5,  5,  5,  7, 4,  // 0x20
+    4,  10, 13, 5,  10, 10, 10, 4,  4,  10, 13, 5,  5,  5,  7, 4,  // 0x30
+    5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7, 5,  // 0x40
+    5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7, 5,  // 0x50
+    5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7, 5,  // 0x60
+    7,  7,  7,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7, 5,  // 0x70
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7, 4,  // 0x80
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7, 4,  // 0x90
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7, 4,  // 0xa0
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7, 4,  // 0xb0
+    5,  10, 10, 10, 11, 11, 7,  11, 5,  10, 10, 10, 11, 17, 7, 11, // 0xc0
+    5,  10, 10, 10, 11, 11, 7,  11, 5,  10, 10, 10, 11, 17, 7, 11, // 0xd0
+    5,  10, 10, 18, 11, 11, 7,  11, 5,  5,  10, 4,  11, 17, 7, 11, // 0xe0
+    5,  10, 10, 4,  11, 11, 7,  11, 5,  5,  10, 4,  11, 17, 7, 11, // 0xf0
+};
+
+// RETURN INSTRUCTIONS
+
+void ret(State *state) { pop(state, &state->pc); }
+
+void conditionalReturn(State *state, uint8_t condition) {
+    if (condition) {
+        ret(state);
+        state->cycles += CONDITIONAL_TAKEN_CYCLES;
+    }
+}
+
+// return if value is 0
+void rnz(State *state) { conditionalReturn(state, isFlagSet(state, Z_FLAG) == 0); }
+
+// return if value is 1
+void rz(State *state) { conditionalReturn(state, isFlagSet(state, Z_FLAG) == 1); }
+
+// return if carry bit is not set
+void rnc(State *state) { conditionalReturn(state, isFlagSet(state, CY_FLAG) == 0); }
+
+// return if carry bit is set
+void rc(State *state) { conditionalReturn(state, isFlagSet(state, CY_FLAG) == 1); }
+
+// return if positive (sign bit is 0)
+void rp(State *state) { conditionalReturn(state, isFlagSet(state, S_FLAG) == 0); }
+
+// return if negative (sign bit is 1)
+void rm(State *state) { conditionalReturn(state, isFlagSet(state, S_FLAG) == 1); }
+
+// return if odd parity (parity bit is 0)
+void rpo(State *state) { conditionalReturn(state, isFlagSet(state, P_FLAG) == 0); }
+
+// return if even parity (parity bit is 1)
+void rpe(State *state) { conditionalReturn(state, isFlagSet(state, P_FLAG) == 1); }
+
+// JUMP INSTRUCTIONS
+
+void jmp(State *state, uint16_t addr) { state->pc = addr; }
+
+// the address has already been read by nextWord, so the pc is left pointing at
+// the next instruction when the jump is not taken
+void conditionalJump(State *state, uint16_t addr, uint8_t condition) {
+    if (condition) {
+        jmp(state, addr);
+    }
+}
+
+// jump if value is 0
+void jnz(State *state, uint16_t addr) {
+    conditionalJump(state, addr, isFlagSet(state, Z_FLAG) == 0);
+}
+
+// jump if value is 1
+void jz(State *state, uint16_t addr) {
+    conditionalJump(state, addr, isFlagSet(state, Z_FLAG) == 1);
+}
+
+// jump if carry bit is not set
+void jnc(State *state, uint16_t addr) {
+    conditionalJump(state, addr, isFlagSet(state, CY_FLAG) == 0);
+}
+
+// jump if carry bit is set
+void jc(State *state, uint16_t addr) {
+    conditionalJump(state, addr, isFlagSet(state, CY_FLAG) == 1);
+}
+
+// jump if positive (sign bit is 0)
+void jp(State *state, uint16_t addr) {
+    conditionalJump(state, addr, isFlagSet(state, S_FLAG) == 0);
+}
+
+// jump if negative (sign bit is 1)
+void jm(State *state, uint16_t addr) {
+    conditionalJump(state, addr, isFlagSet(state, S_FLAG) == 1);
+}
+
+// jump if odd parity (parity bit is 0)
+void jpo(State *state, uint16_t addr) {
+    conditionalJump(state, addr, isFlagSet(state, P_FLAG) == 0);
+}
+
+// jump if even parity (parity bit is 1)
+void jpe(State *state, uint16_t addr) {
+    conditionalJump(state, addr, isFlagSet(state, P_FLAG) == 1);
+}
+
+// CALL INSTRUCTIONS
+
+void call(State *state, uint16_t addr) {
+    push(state, state->pc); // pushes the return address to the stack
+    jmp(state, addr);
+}
+
+void conditionalCall(State *state, uint16_t addr, uint8_t condition) {
+    if (condition) {
+        call(state, addr);
+        state->cycles += CONDITIONAL_TAKEN_CYCLES;
+    }
+}
+
+// call if value is 0
+void cnz(State *state, uint16_t addr) {
+    conditionalCall(state, addr, isFlagSet(state, Z_FLAG) == 0);
+}
+
+// call if value is 1
+void cz(State *state, uint16_t addr) {
+    conditionalCall(state, addr, isFlagSet(state, Z_FLAG) == 1);
+}
+
+// call if carry bit is not set
+void cnc(State *state, uint16_t addr) {
+    conditionalCall(state, addr, isFlagSet(state, CY_FLAG) == 0);
+}
+
+// call if carry bit is set
+void cc(State *state, uint16_t addr) {
+    conditionalCall(state, addr, isFlagSet(state, CY_FLAG) == 1);
+}
+
+// call if positive (sign bit is 0)
+void cp(State *state, uint16_t addr) {
+    conditionalCall(state, addr, isFlagSet(state, S_FLAG) == 0);
+}
+
+// call if negative (sign bit is 1)
+void cm(State *state, uint16_t addr) {
+    conditionalCall(state, addr, isFlagSet(state, S_FLAG) == 1);
+}
+
+// call if odd parity (parity bit is 0)
+void cpo(State *state, uint16_t addr) {
+    conditionalCall(state, addr, isFlagSet(state, P_FLAG) == 0);
+}
+
+// call if even parity (parity bit is 1)
+void cpe(State *state, uint16_t addr) {
+    conditionalCall(state, addr, isFlagSet(state, P_FLAG) == 1);
+}
+
+// INTERRUPT INSTRUCTIONS
+
+void rst(State *state, uint8_t n) { call(state, 8 * n); }
+
+// the interrupting device puts an RST instruction on the data bus, so an
+// interrupt costs the same as executing one
+void GenerateInterrupt(State *state, int rst) {
+    if (!state->interruptEnabled) {
+        return;
+    }
+
+    // a halted cpu carries on after the HLT once the handler returns
+    if (state->halted) {
+        state->halted = 0;
+        state->pc++;
+    }
+
+    // the 8080 disables interrupts when it accepts one, the handler enables
+    // them again with EI
+    state->interruptEnabled = 0;
+    push(state, state->pc);
+    jmp(state, 8 * rst);
+    state->cycles += cycleTable[0xc7];
+}
+
+// expands X once for every opcode, in opcode order. Used to build the label
+// and handler tables for the threaded engine
+#define OPCODE_LIST(X)                                                         \
+    X(0x00), X(0x01), X(0x02), X(0x03), X(0x04), X(0x05), X(0x06), X(0x07),    \
+    X(0x08), X(0x09), X(0x0a), X(0x0b), X(0x0c), X(0x0d), X(0x0e), X(0x0f),    \
+    X(0x10), X(0x11), X(0x12), X(0x13), X(0x14), X(0x15), X(0x16), X(0x17),    \
+    X(0x18), X(0x19), X(0x1a), X(0x1b), X(0x1c), X(0x1d), X(0x1e), X(0x1f),    \
+    X(0x20), X(0x21), X(0x22), X(0x23), X(0x24), X(0x25), X(0x26), X(0x27),    \
+    X(0x28), X(0x29), X(0x2a), X(0x2b), X(0x2c), X(0x2d), X(0x2e), X(0x2f),    \
+    X(0x30), X(0x31), X(0x32), X(0x33), X(0x34), X(0x35), X(0x36), X(0x37),    \
+    X(0x38), X(0x39), X(0x3a), X(0x3b), X(0x3c), X(0x3d), X(0x3e), X(0x3f),    \
+    X(0x40), X(0x41), X(0x42), X(0x43), X(0x44), X(0x45), X(0x46), X(0x47),    \
+    X(0x48), X(0x49), X(0x4a), X(0x4b), X(0x4c), X(0x4d), X(0x4e), X(0x4f),    \
+    X(0x50), X(0x51), X(0x52), X(0x53), X(0x54), X(0x55), X(0x56), X(0x57),    \
+    X(0x58), X(0x59), X(0x5a), X(0x5b), X(0x5c), X(0x5d), X(0x5e), X(0x5f),    \
+    X(0x60), X(0x61), X(0x62), X(0x63), X(0x64), X(0x65), X(0x66), X(0x67),    \
+    X(0x68), X(0x69), X(0x6a), X(0x6b), X(0x6c), X(0x6d), X(0x6e), X(0x6f),    \
+    X(0x70), X(0x71), X(0x72), X(0x73), X(0x74), X(0x75), X(0x76), X(0x77),    \
+    X(0x78), X(0x79), X(0x7a), X(0x7b), X(0x7c), X(0x7d), X(0x7e), X(0x7f),    \
+    X(0x80), X(0x81), X(0x82), X(0x83), X(0x84), X(0x85), X(0x86), X(0x87),    \
+    X(0x88), X(0x89), X(0x8a), X(0x8b), X(0x8c), X(0x8d), X(0x8e), X(0x8f),    \
+    X(0x90), X(0x91), X(0x92), X(0x93), X(0x94), X(0x95), X(0x96), X(0x97),    \
+    X(0x98), X(0x99), X(0x9a), X(0x9b), X(0x9c), X(0x9d), X(0x9e), X(0x9f),    \
+    X(0xa0), X(0xa1), X(0xa2), X(0xa3), X(0xa4), X(0xa5), X(0xa6), X(0xa7),    \
+    X(0xa8), X(0xa9), X(0xaa), X(0xab), X(0xac), X(0xad), X(0xae), X(0xaf),    \
+    X(0xb0), X(0xb1), X(0xb2), X(0xb3), X(0xb4), X(0xb5), X(0xb6), X(0xb7),    \
+    X(0xb8), X(0xb9), X(0xba), X(0xbb), X(0xbc), X(0xbd), X(0xbe), X(0xbf),    \
+    X(0xc0), X(0xc1), X(0xc2), X(0xc3), X(0xc4), X(0xc5), X(0xc6), X(0xc7),    \
+    X(0xc8), X(0xc9), X(0xca), X(0xcb), X(0xcc), X(0xcd), X(0xce), X(0xcf),    \
+    X(0xd0), X(0xd1), X(0xd2), X(0xd3), X(0xd4), X(0xd5), X(0xd6), X(0xd7),    \
+    X(0xd8), X(0xd9), X(0xda), X(0xdb), X(0xdc), X(0xdd), X(0xde), X(0xdf),    \
+    X(0xe0), X(0xe1), X(0xe2), X(0xe3), X(0xe4), X(0xe5), X(0xe6), X(0xe7),    \
+    X(0xe8), X(0xe9), X(0xea), X(0xeb), X(0xec), X(0xed), X(0xee), X(0xef),    \
+    X(0xf0), X(0xf1), X(0xf2), X(0xf3), X(0xf4), X(0xf5), X(0xf6), X(0xf7),    \
+    X(0xf8), X(0xf9), X(0xfa), X(0xfb), X(0xfc), X(0xfd), X(0xfe), X(0xff)
+
+void Emulate(State *state) {
+    PROFILE_STEP(state);
+    unsigned char opcode =
+        nextByte(state); // the opcode is indicated by the program counter's
+                         // index in memory
+    state->cycles += cycleTable[opcode];
+
+#define OPCODE(op) case op: {
+#define END_OPCODE                                                             \
+    }                                                                          \
+    break;
+
+    switch (opcode) {
+#include "opcodes.inc"
+
+    default:
+        fprintf(stderr, "Unknown opcode: 0x%02x\n", opcode);
+        exit(EXIT_FAILURE);
+    }
+
+#undef OPCODE
+#undef END_OPCODE
+}
+
+int EmulateCycles(State *state, int cycles) {
+    uint64_t start = state->cycles;
+    uint64_t end = start + cycles;
+
+    while (state->cycles < end) {
+        Emulate(state);
+    }
+    return (int)(state->cycles - start);
+}
+
+// THREADED ENGINE -- runs many instructions per call so the cost of entering
+// the interpreter is paid once per batch instead of once per instruction
+
+#define ENGINE_NAME EmulateThreaded
+#define ENGINE_HANDLER(op) handle_##op
+#include "engine.inc"
+
+// TRACE ENGINE -- the threaded engine again, writing a trace record as it
+// fetches every instruction. It is a separate engine so the others pay
+// nothing for it
+
+static int runTracedSlice(State *state, int cycles);
+
+#define ENGINE_NAME runTracedSlice
+#define ENGINE_HANDLER(op) handleTraced_##op
+#define ENGINE_FETCH(state) traceNextOpcode(state)
+#include "engine.inc"
+
+// the buffer is flushed once before a slice that might not fit in it, rather
+// than checked for room after every record. A slice runs at most one record
+// for every TRACE_MIN_INSTRUCTION_CYCLES of its budget, plus the one that goes
+// past the end
+int EmulateTraced(State *state, int cycles) {
+    Trace *trace = state->trace;
+    int ran = 0;
+    while (ran < cycles) {
+        int slice = cycles - ran;
+        int room = TRACE_BUFFER_RECORDS - trace->count;
+        if (slice / TRACE_MIN_INSTRUCTION_CYCLES + 1 > room) {
+            flushTrace(trace);
+            int most = (TRACE_BUFFER_RECORDS - 1) * TRACE_MIN_INSTRUCTION_CYCLES;
+            slice = slice < most ? slice : most;
+        }
+        ran += runTracedSlice(state, slice);
+    }
+    return ran;
+}
+
+// LAZY FLAGS ENGINE -- the same threaded engine, but the ALU instructions
+// only record their operands. Most flag results are overwritten before anything
+// reads them, so the flags are only worked out when they are read, or when the
+// engine returns so the state is always complete between calls
+
+#define add lazyAdd
+#define adc lazyAdc
+#define sub lazySub
+#define sbb lazySbb
+#define cmp lazyCmp
+#define ana lazyAna
+#define ora lazyOra
+#define xra lazyXra
+#define inr lazyInr
+#define dcr lazyDcr
+
+#define ENGINE_NAME EmulateLazy
+#define ENGINE_HANDLER(op) handleLazy_##op
+#define ENGINE_EXIT(state) materializeFlags(state)
+#include "engine.inc"
+
+#undef add
+#undef adc
+#undef sub
+#undef sbb
+#undef cmp
+#undef ana
+#undef ora
+#undef xra
+#undef inr
+#undef dcr
+
+// BLOCK ENGINE -- runs the blocks of pre-decoded instructions in the block
+// cache. The opcode bodies take their immediates from the micro-op instead of
+// fetching them, and move the pc past them just as nextByte and nextWord do,
+// so the pc is always right and the engine can stop after any instruction
+
+// runs the compiled code of the block, compiling it once it is hot. Returns 0
+// if the block has no compiled code and has to be interpreted
+static int runNative(State *state, Block *block) {
+    if (block->native == NULL && block->hits++ == JIT_THRESHOLD) {
+        compileBlock(state, block);
+    }
+    if (block->native == NULL) {
+        return 0;
+    }
+
+    if (block->native(state)) {
+        Emulate(state);
+    }
+    return 1;
+}
+
+#define nextByte(state) ((state)->pc += 1, (uint8_t)uop->operand)
+#define nextWord(state) ((state)->pc += 2, uop->operand)
+
+#ifdef EMULATOR_COMPUTED_GOTO
+
+static int runBlocks(State *state, int cycles, int jit) {
+#define LABEL_ADDRESS(op) &&block_##op
+    static void *const dispatchTable[256] = {OPCODE_LIST(LABEL_ADDRESS)};
+#undef LABEL_ADDRESS
+
+    BlockCache *cache = blockCache(state);
+    uint64_t start = state->cycles;
+    uint64_t end = start + cycles;
+    const MicroOp *uop;
+    const MicroOp *last;
+
+    // a block also stops early when one of its instructions flushed the cache
+#define DISPATCH()                                                             \
+    do {                                                                       \
+        if (uop == last || cache->flushed)                                     \
+            goto nextBlock;                                                    \
+        PROFILE_STEP(state);                                                   \
+        state->pc++;                                                           \
+        state->cycles += cycleTable[uop->opcode];                              \
+        goto *dispatchTable[uop->opcode];                                      \
+    } while (0)
+
+#define OPCODE(op) block_##op : {
+#define END_OPCODE                                                             \
+    }                                                                          \
+    uop++;                                                                     \
+    DISPATCH();
+
+nextBlock:
+    if (state->cycles >= end) {
+        return (int)(state->cycles - start);
+    }
+    {
+        Block *block = cache->blockAt[state->pc];
+        if (block == NULL) {
+            block = translateBlock(state, state->pc);
+        }
+
+        // the last block of the budget runs an instruction at a time, so
+        // the blocks before it need not check the budget
+        if (state->cycles + block->cycles >= end) {
+            while (state->cycles < end) {
+                Emulate(state);
+            }
+            return (int)(state->cycles - start);
+        }
+
+        if (jit && runNative(state, block)) {
+            goto nextBlock;
+        }
+
+        cache->flushed = 0;
+        uop = block->ops;
+        last = uop + block->count;
+    }
+    DISPATCH();
+#include "opcodes.inc"
+
+#undef OPCODE
+#undef END_OPCODE
+#undef DISPATCH
+
+    return (int)(state->cycles - start);
+}
+
+#else
+
+// not every opcode body uses the state or the micro-op
+#define OPCODE(op)                                                             \
+    static void handleBlock_##op(State *state, const MicroOp *uop) {           \
+        (void)state;                                                           \
+        (void)uop;
+#define END_OPCODE }
+
+#include "opcodes.inc"
+
+#undef OPCODE
+#undef END_OPCODE
+
+static int runBlocks(State *state, int cycles, int jit) {
+#define BLOCK_HANDLER(op) handleBlock_##op
+    static void (*const handlerTable[256])(State *, const MicroOp *) = {
+        OPCODE_LIST(BLOCK_HANDLER)};
+#undef BLOCK_HANDLER
+
+    BlockCache *cache = blockCache(state);
+    uint64_t start = state->cycles;
+    uint64_t end = start + cycles;
+
+    while (state->cycles < end) {
+        Block *block = cache->blockAt[state->pc];
+        if (block == NULL) {
+            block = translateBlock(state, state->pc);
+        }
+        if (state->cycles + block->cycles < end && jit &&
+            runNative(state, block)) {
+            continue;
+        }
+        cache->flushed = 0;
+
+        const MicroOp *last = block->ops + block->count;
+        for (const MicroOp *uop = block->ops;
+             uop != last && state->cycles < end && !cache->flushed; uop++) {
+            PROFILE_STEP(state);
+            state->pc++;
+            state->cycles += cycleTable[uop->opcode];
+            handlerTable[uop->opcode](state, uop);
+        }
+    }
+
+    return (int)(state->cycles - start);
+}
+
+#endif
+
+#undef nextByte
+#undef nextWord
+
+int EmulateBlocks(State *state, int cycles) {
+    return runBlocks(state, cycles, 0);
+}
+
+int EmulateJit(State *state, int cycles) {
+#ifdef EMULATOR_PROFILER
+    // compiled blocks can't count their instructions
+    return runBlocks(state, cycles, state->profile == NULL);
+#else
+    return runBlocks(state, cycles, 1);
+#endif
+}
+
+// ENGINES -- every run loop, so that they can be picked by name
+
+const Engine engines[] = {
+    {"switch", EmulateCycles},
+    {"threaded", EmulateThreaded},
+    {"lazy", EmulateLazy},
+    {"blocks", EmulateBlocks},
+    {"jit", EmulateJit},
+};
+const int engineCount = sizeof(engines) / sizeof(engines[0]);
+
+// returns the engine with the given name, or NULL if there isn't one
+const Engine *findEngine(const char *name) {
+    for (int i = 0; i < engineCount; i++) {
+        if (strcmp(engines[i].name, name) == 0) {
+            return &engines[i];
+        }
+    }
+    return NULL;
+}
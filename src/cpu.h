@@ -0,0 +1,164 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// memory size
+#define MEMORY_SIZE 0x10000               // 65536 bytes
+#define MAX_MEMORY_SIZE (MEMORY_SIZE - 1) // 65535 bytes
+
+// the memory map is split into 256 byte pages, see memory.h
+#define PAGE_SHIFT 8
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_MASK (PAGE_SIZE - 1)
+#define PAGE_COUNT (MEMORY_SIZE / PAGE_SIZE)
+
+// IN and OUT address 256 ports, see ports.h
+#define PORT_COUNT 256
+#define INPUT_PORT_COUNT 4
+
+// one bit for each of the 224 columns of video RAM, see video.h
+#define DIRTY_COLUMN_WORDS 4
+
+// stack size
+#define STACK_TOP 0xFFFF
+#define STACK_BOTTOM 0x8000
+
+// the threaded engine uses computed goto on compilers that support labels as
+// values, and falls back to a table of handler functions everywhere else
+#if !defined(EMULATOR_NO_COMPUTED_GOTO) &&                                     \
+    (defined(__GNUC__) || defined(__clang__))
+#define EMULATOR_COMPUTED_GOTO 1
+#endif
+
+// FLAGS -- positions of the flags in the PSW byte that PUSH PSW pushes
+
+#define S_FLAG (1 << 7)
+#define Z_FLAG (1 << 6)
+#define AC_FLAG (1 << 4)
+#define P_FLAG (1 << 2)
+#define CY_FLAG (1 << 0)
+#define PSW_FLAGS (S_FLAG | Z_FLAG | AC_FLAG | P_FLAG | CY_FLAG)
+
+// bit 1 of the PSW always reads as 1, bits 3 and 5 always read as 0
+#define PSW_FIXED_BITS (1 << 1)
+
+typedef struct State State;
+typedef struct BlockCache BlockCache;
+typedef struct Trace Trace;
+typedef struct Profile Profile;
+typedef struct Fork Fork;
+
+// called for writes to a page that has no write pointer
+typedef void (*WriteHandler)(State *state, uint16_t address, uint8_t value);
+
+// devices on the IN and OUT ports
+typedef uint8_t (*PortReader)(State *state, uint8_t port);
+typedef void (*PortWriter)(State *state, uint8_t port, uint8_t value);
+
+struct State {
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint8_t d;
+    uint8_t e;
+    uint8_t h;
+    uint8_t l;
+    uint16_t sp;
+    uint16_t pc;
+    uint8_t *memory; // this is an array that stores integers.
+    uint8_t flags; // stored exactly as the PSW byte, see the FLAGS section
+    // operation the lazy engine has not worked out the flags for yet
+    uint8_t lazyOp;
+    uint8_t lazyAccumulator;
+    uint8_t lazyValue;
+    uint16_t lazyResult;
+    uint8_t interruptEnabled;
+    uint8_t halted; // set by HLT, the pc stays on it until an interrupt
+    uint64_t cycles; // total cycles executed since the machine was set up
+
+    // page table, every access looks up the page for its address here. A page
+    // with no write pointer sends its writes to its write handler instead
+    uint8_t *readPages[PAGE_COUNT];
+    uint8_t *writePages[PAGE_COUNT];
+    WriteHandler writeHandlers[PAGE_COUNT];
+    uint8_t discardPage[PAGE_SIZE]; // writes to ROM pages end up here
+
+    // port table, IN and OUT call the device mapped to the port
+    PortReader portReaders[PORT_COUNT];
+    PortWriter portWriters[PORT_COUNT];
+    uint8_t inputPorts[INPUT_PORT_COUNT]; // bits the input ports read as
+    uint16_t shiftRegister; // last two bytes written to the shift register
+    uint8_t shiftOffset;
+    FILE *console; // where the CP/M BDOS prints, see cpm.h
+
+    // video RAM columns written to since they were last rendered
+    uint64_t dirtyColumns[DIRTY_COLUMN_WORDS];
+
+    // decoded blocks of the block engine, created when it first runs
+    BlockCache *blockCache;
+
+    // where the trace engine writes its records, see trace.h
+    Trace *trace;
+
+    // counts of what the interpreters ran, only used when the profiler is
+    // built in, see profile.h
+    Profile *profile;
+
+    // the memory shared with the machines it was forked from or into, NULL
+    // for a machine that has never been forked, see fork.h
+    Fork *fork;
+};
+
+State *setupStateMachine();
+void freeStateMachine(State *state);
+void outputStateValues(State *state);
+
+// returns 1 if the flag is set and 0 if it isn't
+uint8_t isFlagSet(State *state, uint8_t flag);
+
+// executes a single instruction through the switch statement
+void Emulate(State *state);
+
+// both run loops execute instructions until at least the given number of
+// cycles has been used up, and return the cycles they actually consumed. The
+// last instruction can take the total a few cycles past the budget
+int EmulateCycles(State *state, int cycles);
+int EmulateThreaded(State *state, int cycles);
+
+// threaded engine that only works out the flags when they are read
+int EmulateLazy(State *state, int cycles);
+
+// threaded engine that writes a record of every instruction to state->trace,
+// which has to be set
+int EmulateTraced(State *state, int cycles);
+
+// runs blocks of pre-decoded instructions from a cache, see blocks.h
+int EmulateBlocks(State *state, int cycles);
+
+// the block engine with the hot blocks compiled to x86-64, see jit.h
+int EmulateJit(State *state, int cycles);
+
+// runs RST rst as if a device had interrupted the cpu. Nothing happens when
+// interrupts are disabled
+void GenerateInterrupt(State *state, int rst);
+
+// clock cycles each opcode takes. Conditional calls and returns take
+// CONDITIONAL_TAKEN_CYCLES more when the condition is met
+extern const uint8_t cycleTable[256];
+#define CONDITIONAL_TAKEN_CYCLES 6
+
+// a run loop that can be picked by name
+typedef struct Engine {
+    const char *name;
+    int (*run)(State *state, int cycles);
+} Engine;
+
+extern const Engine engines[];
+extern const int engineCount;
+
+const Engine *findEngine(const char *name);
+
+#endif
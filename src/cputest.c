@@ -0,0 +1,164 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "cpm.h"
+#include "cpu.h"
+
+// CPU TESTS -- runs 8080 test programs under the CP/M stub to the end, on
+// every engine or the one given with --engine, and prints what they print as
+// they go. Given a directory it runs every one of the standard test programs
+// that is in it. A program passes when it gets to the warm boot without
+// printing an error or a failure. 8080EXM runs for billions of instructions,
+// so its MHz are a good measure of each engine too
+
+// how often the output printed so far is shown
+#define CYCLES_PER_SLICE 2000000
+
+#define MAX_PROGRAMS 64
+#define MAX_PATH_LENGTH 4096
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// returns 1 if the output says anything went wrong, in any case. NUL bytes
+// are left out, as they would hide the rest of the output from strstr
+static int reportsFailure(const char *output, size_t size) {
+    char *lower = malloc(size + 1);
+    if (lower == NULL) {
+        return 1;
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (output[i] != '\0') {
+            lower[length++] = tolower((unsigned char)output[i]);
+        }
+    }
+    lower[length] = '\0';
+
+    int failed =
+        strstr(lower, "error") != NULL || strstr(lower, "fail") != NULL;
+    free(lower);
+    return failed;
+}
+
+// returns 1 if the program passed, 0 if it failed and -1 if it failed to
+// load. cycles is the most it may run for, 0 for no limit
+static int runProgram(const char *path, const Engine *engine, long cycles) {
+    char *output = NULL;
+    size_t size = 0;
+    FILE *console = open_memstream(&output, &size);
+    if (console == NULL) {
+        perror("Failed to capture the output");
+        return -1;
+    }
+
+    State *state = setupStateMachine();
+    if (loadCpmProgram(state, path, console) < 0) {
+        freeStateMachine(state);
+        fclose(console);
+        free(output);
+        return -1;
+    }
+
+    printf("%s on %s\n", path, engine->name);
+    size_t shown = 0;
+    double start = now();
+    while (!cpmFinished(state) &&
+           (cycles == 0 || state->cycles < (uint64_t)cycles)) {
+        engine->run(state, CYCLES_PER_SLICE);
+
+        fflush(console);
+        fwrite(output + shown, 1, size - shown, stdout);
+        fflush(stdout);
+        shown = size;
+    }
+    double time = now() - start;
+
+    int finished = cpmFinished(state);
+    fclose(console);
+    int passed = finished && !reportsFailure(output, size);
+    printf("\n%s: %s after %llu cycles, %.2fs, %.1f MHz\n\n",
+           passed     ? "passed"
+           : finished ? "FAILED"
+                      : "FAILED, did not finish",
+           path, (unsigned long long)state->cycles, time,
+           state->cycles / time / 1e6);
+
+    free(output);
+    freeStateMachine(state);
+    return passed;
+}
+
+// adds the program, or every standard test program in the directory
+static void addPrograms(char (*paths)[MAX_PATH_LENGTH], int *count,
+                        const char *path) {
+    struct stat info;
+    if (stat(path, &info) < 0 || !S_ISDIR(info.st_mode)) {
+        snprintf(paths[(*count)++], MAX_PATH_LENGTH, "%s", path);
+        return;
+    }
+
+    for (int i = 0; i < CPM_TEST_PROGRAM_COUNT; i++) {
+        snprintf(paths[*count], MAX_PATH_LENGTH, "%s/%s", path,
+                 cpmTestPrograms[i]);
+        if (stat(paths[*count], &info) == 0) {
+            (*count)++;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const Engine *only = NULL;
+    long cycles = 0;
+    static char paths[MAX_PROGRAMS][MAX_PATH_LENGTH];
+    int pathCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            only = findEngine(argv[++i]);
+            if (only == NULL) {
+                fprintf(stderr, "Unknown engine: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = atol(argv[++i]);
+        } else if (pathCount + CPM_TEST_PROGRAM_COUNT <= MAX_PROGRAMS) {
+            addPrograms(paths, &pathCount, argv[i]);
+        }
+    }
+    if (pathCount == 0) {
+        printf("Usage: %s [--engine switch|threaded|lazy|blocks|jit] "
+               "[--cycles n] <testdir | program...>\n\n"
+               "The standard test programs are ",
+               argv[0]);
+        for (int i = 0; i < CPM_TEST_PROGRAM_COUNT; i++) {
+            printf("%s%s", cpmTestPrograms[i],
+                   i + 1 < CPM_TEST_PROGRAM_COUNT ? ", " : "\n");
+        }
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < pathCount; i++) {
+        for (int j = 0; j < engineCount; j++) {
+            if (only != NULL && only != &engines[j]) {
+                continue;
+            }
+            int passed = runProgram(paths[i], &engines[j], cycles);
+            if (passed < 0) {
+                return EXIT_FAILURE;
+            }
+            failures += !passed;
+        }
+    }
+
+    printf("%d of %d runs failed\n", failures,
+           pathCount * (only != NULL ? 1 : engineCount));
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,6 +1,7 @@
-#include "stdio.h"
-#include "stdlib.h"
-//
+#include "disassemble.h"
+
+#include <stdio.h>
+
 int Disassemble8080p(unsigned char *codebuffer, int pc) {
 
     unsigned char *code = &codebuffer[pc];
@@ -812,52 +813,3 @@ int Disassemble8080p(unsigned char *codebuffer, int pc) {
     printf("\n");
     return opbytes;
 }
-
-long getFileSize(FILE *fptr) {
-    // checks for null pointer
-    if (fptr == NULL) {
-        return -1;
-    }
-
-    // stores the original position of the pointer
-    long original_position = ftell(fptr);
-    if (original_position == -1L) {
-        perror("ftell error");
-        return -1;
-    }
-
-    // goes to the end of the file, gets the size and then goes back to original
-    // position
-    fseek(fptr, 0, SEEK_END);
-    long size = ftell(fptr);
-    fseek(fptr, original_position, SEEK_SET);
-
-    return size;
-}
-
-int main(int argc, char **argv) {
-    // open the exectuable
-    FILE *fptr;
-    fptr = fopen(argv[1], "rb");
-
-    if (fptr == NULL) {
-        printf("Error opening the file");
-        exit(1);
-    }
-
-    // allocate the binary to some space
-    long fileSize = getFileSize(fptr);
-    unsigned char *buffer = malloc(fileSize);
-
-    // read the binary into the buffer
-    fread(buffer, fileSize, 1, fptr);
-
-    // close and free the pointer
-    fclose(fptr);
-
-    int pc = 0;
-
-    while (pc < fileSize) {
-        pc += Disassemble8080p(buffer, pc);
-    }
-}
@@ -0,0 +1,8 @@
+#ifndef DISASSEMBLE_H
+#define DISASSEMBLE_H
+
+// prints the instruction at codebuffer[pc] on a line of its own, and returns
+// the number of bytes it takes up
+int Disassemble8080p(unsigned char *codebuffer, int pc);
+
+#endif
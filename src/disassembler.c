@@ -0,0 +1,107 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "disassemble.h"
+#include "trace.h"
+
+long getFileSize(FILE *fptr) {
+    // checks for null pointer
+    if (fptr == NULL) {
+        return -1;
+    }
+
+    // stores the original position of the pointer
+    long original_position = ftell(fptr);
+    if (original_position == -1L) {
+        perror("ftell error");
+        return -1;
+    }
+
+    // goes to the end of the file, gets the size and then goes back to original
+    // position
+    fseek(fptr, 0, SEEK_END);
+    long size = ftell(fptr);
+    fseek(fptr, original_position, SEEK_SET);
+
+    return size;
+}
+
+// prints every record of a trace written by the trace engine, with the
+// instruction disassembled. Returns 0 on success
+int printTrace(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, file) != 1 ||
+        memcmp(header, "8080TRCE", 8) != 0 ||
+        (header[8] | (header[9] << 8)) != TRACE_VERSION ||
+        (header[10] | (header[11] << 8)) != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s is not a trace this version can read\n", path);
+        fclose(file);
+        return 1;
+    }
+
+    // the instruction is put back at its address, so the disassembly shows
+    // the address it ran at
+    static unsigned char code[MEMORY_SIZE + 2];
+    static TraceRecord records[4096];
+    uint64_t index = 0;
+    size_t count;
+    while ((count = fread(records, sizeof(TraceRecord), 4096, file)) > 0) {
+        for (size_t i = 0; i < count; i++, index++) {
+            TraceRecord *record = &records[i];
+            uint16_t pc = littleEndian16(record->pc);
+            code[pc] = record->opcode;
+            code[pc + 1] = record->operands[0];
+            code[pc + 2] = record->operands[1];
+
+            printf("%10llu a=%02x f=%02x sp=%04x hl=%04x  ",
+                   (unsigned long long)index, record->a, record->flags,
+                   littleEndian16(record->sp), littleEndian16(record->hl));
+            Disassemble8080p(code, pc);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "--trace") == 0) {
+        return printTrace(argv[2]);
+    }
+    if (argc != 2) {
+        printf("Usage: %s <romfile> | --trace <tracefile>\n", argv[0]);
+        return 1;
+    }
+
+    // open the exectuable
+    FILE *fptr;
+    fptr = fopen(argv[1], "rb");
+
+    if (fptr == NULL) {
+        printf("Error opening the file");
+        exit(1);
+    }
+
+    // allocate the binary to some space
+    long fileSize = getFileSize(fptr);
+    unsigned char *buffer = malloc(fileSize);
+
+    // read the binary into the buffer
+    fread(buffer, fileSize, 1, fptr);
+
+    // close and free the pointer
+    fclose(fptr);
+
+    int pc = 0;
+
+    while (pc < fileSize) {
+        pc += Disassemble8080p(buffer, pc);
+    }
+}
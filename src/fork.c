@@ -0,0 +1,173 @@
+#include "fork.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blocks.h"
+#include "memory.h"
+
+static void releaseShared(SharedMemory *shared) {
+    if (atomic_fetch_sub(&shared->references, 1) == 1) {
+        free(shared->bytes);
+        free(shared);
+    }
+}
+
+// the first write to a shared page copies it, and then goes wherever writes
+// to the page went before it was shared
+static void copyOnWrite(State *state, uint16_t address, uint8_t value) {
+    int page = address >> PAGE_SHIFT;
+    unsharePage(state, page);
+
+    WriteHandler handler = state->fork->savedWriteHandlers[page];
+    if (handler != NULL) {
+        handler(state, address, value);
+    } else {
+        state->readPages[page][address & PAGE_MASK] = value;
+    }
+}
+
+void unsharePage(State *state, int page) {
+    Fork *fork = state->fork;
+    if (fork == NULL || fork->shared[page] == NULL) {
+        return;
+    }
+
+    SharedMemory *shared = fork->shared[page];
+    uint8_t *frozen = state->readPages[page];
+    uint8_t *copy = state->memory + (frozen - shared->bytes);
+    memcpy(copy, frozen, PAGE_SIZE);
+
+    // the mirrors of the page move to the copy with it. The block cache
+    // keeps the write pointer and handler of the pages it has trapped, and
+    // the cached code is still right as the bytes haven't changed
+    BlockCache *cache = state->blockCache;
+    for (int mirror = 0; mirror < PAGE_COUNT; mirror++) {
+        if (state->readPages[mirror] != frozen) {
+            continue;
+        }
+
+        uint8_t **write = &state->writePages[mirror];
+        WriteHandler *handler = &state->writeHandlers[mirror];
+        if (cache != NULL && cache->trapped[mirror]) {
+            write = &cache->savedWritePages[mirror];
+            handler = &cache->savedWriteHandlers[mirror];
+        }
+        if (*handler == copyOnWrite) {
+            *handler = fork->savedWriteHandlers[mirror];
+            *write = *handler == NULL ? copy : NULL;
+        }
+
+        state->readPages[mirror] = copy;
+        fork->shared[mirror] = NULL;
+        releaseShared(shared);
+    }
+}
+
+// hands the pages that read from the machine's own memory over to shared
+// memory, and traps the first write to each of the ones that aren't ROM.
+// Returns -1 if there wasn't the memory for it
+static int shareMemory(State *state) {
+    uintptr_t start = (uintptr_t)state->memory;
+    int owned[PAGE_COUNT];
+    int ownedCount = 0;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if ((uintptr_t)state->readPages[page] - start < MEMORY_SIZE) {
+            owned[ownedCount++] = page;
+        }
+    }
+    if (ownedCount == 0) {
+        return 0;
+    }
+
+    SharedMemory *shared = malloc(sizeof(SharedMemory));
+    uint8_t *memory = malloc(MEMORY_SIZE);
+    if (shared == NULL || memory == NULL) {
+        perror("Failed to allocate memory for the fork");
+        free(shared);
+        free(memory);
+        return -1;
+    }
+    shared->bytes = state->memory;
+    atomic_init(&shared->references, ownedCount);
+    state->memory = memory;
+
+    Fork *fork = state->fork;
+    for (int i = 0; i < ownedCount; i++) {
+        int page = owned[i];
+        fork->shared[page] = shared;
+        if (state->writePages[page] == state->discardPage) {
+            continue;
+        }
+
+        fork->savedWriteHandlers[page] =
+            state->writePages[page] != NULL ? NULL
+                                            : state->writeHandlers[page];
+        state->writePages[page] = NULL;
+        state->writeHandlers[page] = copyOnWrite;
+    }
+    return 0;
+}
+
+State *forkStateMachine(State *parent) {
+    // cached code traps writes to its pages too, and is rebuilt as it runs
+    if (parent->blockCache != NULL) {
+        flushBlockCache(parent);
+    }
+
+    if (parent->fork == NULL) {
+        parent->fork = calloc(1, sizeof(Fork));
+        if (parent->fork == NULL) {
+            perror("Failed to allocate memory for the fork");
+            return NULL;
+        }
+    }
+    if (shareMemory(parent) < 0) {
+        return NULL;
+    }
+
+    State *child = malloc(sizeof(State));
+    Fork *fork = malloc(sizeof(Fork));
+    uint8_t *memory = malloc(MEMORY_SIZE);
+    if (child == NULL || fork == NULL || memory == NULL) {
+        perror("Failed to allocate memory for the fork");
+        free(child);
+        free(fork);
+        free(memory);
+        return NULL;
+    }
+
+    *child = *parent;
+    *fork = *parent->fork;
+    child->memory = memory;
+    child->fork = fork;
+    child->blockCache = NULL;
+    child->trace = NULL;
+    child->profile = NULL;
+
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (fork->shared[page] != NULL) {
+            atomic_fetch_add(&fork->shared[page]->references, 1);
+        }
+        // writes to ROM go to the child's own discard page
+        if (parent->writePages[page] == parent->discardPage) {
+            child->writePages[page] = child->discardPage;
+        }
+    }
+    return child;
+}
+
+void freeFork(State *state) {
+    if (state->fork == NULL) {
+        return;
+    }
+
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (state->fork->shared[page] != NULL) {
+            releaseShared(state->fork->shared[page]);
+        }
+    }
+    free(state->fork);
+    state->fork = NULL;
+}
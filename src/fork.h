@@ -0,0 +1,47 @@
+#ifndef FORK_H
+#define FORK_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+// FORKING -- forkStateMachine copies a machine without copying its memory.
+// The pages the parent has to itself are handed over to memory it shares
+// with the fork, and both of them get a new, empty state->memory to copy
+// pages into. Writes to a shared page are trapped, and the first one copies
+// the page into the writing machine's own memory at the same place, so only
+// the pages a machine writes to cost it memory. Shared memory is freed when
+// no machine reads from it any more. Forks can be forked again, and each
+// machine can run on its own thread, as the shared memory is never written
+
+// memory that used to be a machine's own, now read by it and its forks
+typedef struct SharedMemory {
+    atomic_int references; // pages of all the machines that read from it
+    uint8_t *bytes;
+} SharedMemory;
+
+struct Fork {
+    // the shared memory each page reads from, NULL once it has a copy of its
+    // own or if it never read from a machine's memory, like a mapped ROM file
+    SharedMemory *shared[PAGE_COUNT];
+    // what took the writes to each page before it was shared: its write
+    // handler, or NULL if it was written through its write pointer
+    WriteHandler savedWriteHandlers[PAGE_COUNT];
+};
+
+// returns a new machine in exactly the same state as parent, or NULL if there
+// wasn't the memory for it. Free it with freeStateMachine as usual. The
+// parent's block cache is flushed, and the fork starts with no block cache,
+// trace or profile
+State *forkStateMachine(State *parent);
+
+// gives the page a copy of its own if it is still shared with other machines.
+// Anything that writes to a page's memory without going through the page
+// table has to call this first
+void unsharePage(State *state, int page);
+
+// stops sharing memory with the other machines, called by freeStateMachine
+void freeFork(State *state);
+
+#endif
@@ -0,0 +1,142 @@
+#include "input.h"
+
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ports.h"
+
+static const char inputLogMagic[8] = {'8', '0', '8', '0', 'I', 'N', 'P', 'T'};
+
+// reads the record after the one that has just been played
+static void readRecord(InputLog *log) {
+    uint8_t record[INPUT_RECORD_SIZE];
+    log->pending = fread(record, sizeof(record), 1, log->file) == 1;
+    if (log->pending) {
+        log->nextFrame = record[0] | (record[1] << 8) | (record[2] << 16) |
+                         ((uint32_t)record[3] << 24);
+        log->nextPorts[0] = record[4];
+        log->nextPorts[1] = record[5];
+    }
+}
+
+int startRecording(InputLog *log, const char *path) {
+    memset(log, 0, sizeof(InputLog));
+    log->file = fopen(path, "wb");
+    if (log->file == NULL) {
+        perror(path);
+        return -1;
+    }
+    log->recording = 1;
+
+    uint8_t version[2] = {INPUT_LOG_VERSION & 0xff, INPUT_LOG_VERSION >> 8};
+    fwrite(inputLogMagic, sizeof(inputLogMagic), 1, log->file);
+    fwrite(version, sizeof(version), 1, log->file);
+    return 0;
+}
+
+int startReplay(InputLog *log, const char *path) {
+    memset(log, 0, sizeof(InputLog));
+    log->file = fopen(path, "rb");
+    if (log->file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char magic[8];
+    uint8_t version[2];
+    if (fread(magic, sizeof(magic), 1, log->file) != 1 ||
+        fread(version, sizeof(version), 1, log->file) != 1 ||
+        memcmp(magic, inputLogMagic, sizeof(magic)) != 0 ||
+        (version[0] | (version[1] << 8)) != INPUT_LOG_VERSION) {
+        fprintf(stderr, "%s is not an input log this version can replay\n",
+                path);
+        fclose(log->file);
+        return -1;
+    }
+
+    readRecord(log);
+    return 0;
+}
+
+void logInputs(InputLog *log, State *state, uint32_t frame) {
+    if (!log->recording) {
+        while (log->pending && log->nextFrame <= frame) {
+            setInputPort(state, 1, log->nextPorts[0]);
+            setInputPort(state, 2, log->nextPorts[1]);
+            readRecord(log);
+        }
+        return;
+    }
+
+    // the first frame is always written, so a replay starts from the same
+    // inputs whatever the machine it is played on starts with
+    if (frame != 0 && state->inputPorts[1] == log->ports[0] &&
+        state->inputPorts[2] == log->ports[1]) {
+        return;
+    }
+    log->ports[0] = state->inputPorts[1];
+    log->ports[1] = state->inputPorts[2];
+
+    uint8_t record[INPUT_RECORD_SIZE] = {
+        frame & 0xff, (frame >> 8) & 0xff, (frame >> 16) & 0xff, frame >> 24,
+        log->ports[0], log->ports[1]};
+    fwrite(record, sizeof(record), 1, log->file);
+}
+
+int closeInputLog(InputLog *log) {
+    int failed = ferror(log->file);
+    return fclose(log->file) != 0 || failed ? -1 : 0;
+}
+
+// the port and bit each key presses
+typedef struct Key {
+    char key;
+    uint8_t port;
+    uint8_t bit;
+} Key;
+
+static const Key keys[] = {
+    {'c', 1, PORT1_CREDIT},  {'1', 1, PORT1_P1_START},
+    {'2', 1, PORT1_P2_START}, {'a', 1, PORT1_P1_LEFT},
+    {'d', 1, PORT1_P1_RIGHT}, {' ', 1, PORT1_P1_SHOT},
+};
+
+void startKeyboard(Keyboard *keyboard) {
+    memset(keyboard, 0, sizeof(Keyboard));
+    keyboard->open = 1;
+}
+
+void pollKeyboard(Keyboard *keyboard, State *state) {
+    // only reads what is already there, so a frame never waits for a key
+    struct pollfd input = {.fd = STDIN_FILENO, .events = POLLIN};
+    while (keyboard->open && poll(&input, 1, 0) > 0) {
+        char typed[64];
+        ssize_t count = read(STDIN_FILENO, typed, sizeof(typed));
+        if (count <= 0) {
+            keyboard->open = 0;
+            break;
+        }
+
+        for (ssize_t i = 0; i < count; i++) {
+            for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+                if (typed[i] == keys[k].key) {
+                    int bit = __builtin_ctz(keys[k].bit);
+                    keyboard->heldFrames[keys[k].port - 1][bit] =
+                        KEY_HOLD_FRAMES;
+                }
+            }
+        }
+    }
+
+    for (int port = 1; port <= 2; port++) {
+        uint8_t value = port == 1 ? PORT1_ALWAYS_SET : 0x00;
+        for (int bit = 0; bit < 8; bit++) {
+            if (keyboard->heldFrames[port - 1][bit] > 0) {
+                keyboard->heldFrames[port - 1][bit]--;
+                value |= 1 << bit;
+            }
+        }
+        setInputPort(state, port, value);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+// INPUT LOGS -- a recording of what the space invaders input ports 1 and 2
+// read as, so that a run can be played again with exactly the same inputs.
+// The machine itself is deterministic, so a replay does exactly the same work
+// every time it is run. The file is the magic "8080INPT" and a 16 bit version,
+// followed by a record for every frame the inputs changed on
+//   0  frame number, 32 bits
+//   4  port 1
+//   5  port 2
+// Every number in it is little endian
+#define INPUT_LOG_VERSION 1
+#define INPUT_RECORD_SIZE 6
+
+typedef struct InputLog {
+    FILE *file;
+    int recording;
+
+    // what the ports read as in the last record written or played
+    uint8_t ports[2];
+
+    // the next record of a replay, if there is one
+    int pending;
+    uint32_t nextFrame;
+    uint8_t nextPorts[2];
+} InputLog;
+
+// opens a log to record to or to replay. Both return 0 on success and -1 on
+// failure
+int startRecording(InputLog *log, const char *path);
+int startReplay(InputLog *log, const char *path);
+
+// called before every frame is run. A replay sets the input ports to what
+// they were recorded as, and a recording writes a record if they changed
+void logInputs(InputLog *log, State *state, uint32_t frame);
+
+// returns 0 if the log was written or read without an error
+int closeInputLog(InputLog *log);
+
+// KEYBOARD -- keys typed on stdin press the buttons for KEY_HOLD_FRAMES
+// frames, as there is no window to take key presses from. A terminal only
+// hands the keys over once the line is entered
+//   c coin   1 one player start   2 two player start
+//   a left   d right   space shoot
+#define KEY_HOLD_FRAMES 8
+
+typedef struct Keyboard {
+    int open; // cleared once stdin is closed
+    uint8_t heldFrames[2][8]; // frames each bit of ports 1 and 2 stays set
+} Keyboard;
+
+void startKeyboard(Keyboard *keyboard);
+
+// reads the keys typed since the last frame and sets the input ports
+void pollKeyboard(Keyboard *keyboard, State *state);
+
+#endif
@@ -0,0 +1,649 @@
+#include "jit.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+
+// HOST REGISTERS -- the 8080 registers live in r8-r15 while a block runs and
+// rdi holds the state. eax, ecx and edx are scratch. Only r12-r15 have to be
+// saved, as the compiled code never calls anything
+
+#define HOST_AX 0
+#define HOST_CX 1
+#define HOST_DX 2
+#define HOST_A 8
+#define HOST_F 15
+
+// host register of each 8080 register, in the order the opcodes number them:
+// B, C, D, E, H, L, M and A. M is memory and has none
+static const int hostRegister[8] = {9, 10, 11, 12, 13, 14, -1, HOST_A};
+
+// state field of each host register from r8 to r15
+static const size_t registerOffset[8] = {
+    offsetof(State, a), offsetof(State, b), offsetof(State, c),
+    offsetof(State, d), offsetof(State, e), offsetof(State, h),
+    offsetof(State, l), offsetof(State, flags),
+};
+
+// largest block of code the compiler builds before copying it into the arena
+#define MAX_CODE_SIZE 16384
+#define MAX_FIXUPS (2 * MAX_BLOCK_INSTRUCTIONS + 4)
+
+// a jump to an exit of the block that is filled in once the exit is emitted
+typedef struct Fixup {
+    size_t at; // position of the rel32 to patch
+    uint16_t pc;
+    uint32_t cycles;
+} Fixup;
+
+typedef struct Emitter {
+    uint8_t code[MAX_CODE_SIZE];
+    size_t size;
+    int overflow;
+
+    // writes that found no write pointer stop the block here
+    Fixup bails[MAX_FIXUPS];
+    int bailCount;
+
+    // every exit jumps to the shared epilogue
+    size_t epilogueJumps[MAX_FIXUPS];
+    int epilogueJumpCount;
+} Emitter;
+
+static void emit(Emitter *e, uint8_t byte) {
+    if (e->size < MAX_CODE_SIZE) {
+        e->code[e->size++] = byte;
+    } else {
+        e->overflow = 1;
+    }
+}
+
+static void emit16(Emitter *e, uint16_t value) {
+    emit(e, value & 0xff);
+    emit(e, value >> 8);
+}
+
+static void emit32(Emitter *e, uint32_t value) {
+    emit16(e, value & 0xffff);
+    emit16(e, value >> 16);
+}
+
+// patches the rel32 at position to jump to the current position
+static void patch(Emitter *e, size_t at) {
+    if (e->overflow) {
+        return;
+    }
+    uint32_t rel = (uint32_t)(e->size - (at + 4));
+    memcpy(&e->code[at], &rel, sizeof(rel));
+}
+
+// emits a rel32 jump and returns the position to patch, the opcode bytes are
+// 0xe9 for jmp and 0x0f 0x8? for conditional jumps
+static size_t emitJump(Emitter *e, const uint8_t *opcode, int length) {
+    for (int i = 0; i < length; i++) {
+        emit(e, opcode[i]);
+    }
+    size_t at = e->size;
+    emit32(e, 0);
+    return at;
+}
+
+// REX prefix for registers reg (ModRM reg field) and rm, always emitted so
+// that byte registers 8-15 can be used. Byte registers 4-7 are never used,
+// as a REX prefix would turn them from ah-bh into spl-dil
+static void rex(Emitter *e, int wide, int reg, int rm) {
+    emit(e, 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3));
+}
+
+static void modrm(Emitter *e, int mode, int reg, int rm) {
+    emit(e, (mode << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op dst8, src8 for the ALU opcodes 0x00 add, 0x08 or, 0x10 adc, 0x18 sbb,
+// 0x20 and, 0x28 sub, 0x30 xor, 0x38 cmp, and 0x88 mov
+static void regReg8(Emitter *e, uint8_t opcode, int dst, int src) {
+    rex(e, 0, src, dst);
+    emit(e, opcode);
+    modrm(e, 3, src, dst);
+}
+
+// op dst8, imm8 where digit picks the operation: 0 add, 1 or, 2 adc, 3 sbb,
+// 4 and, 5 sub, 6 xor, 7 cmp
+static void regImm8(Emitter *e, int digit, int dst, uint8_t imm) {
+    rex(e, 0, 0, dst);
+    emit(e, 0x80);
+    modrm(e, 3, digit, dst);
+    emit(e, imm);
+}
+
+// single operand instructions of the 0xfe, 0xf6 and 0xd0 groups
+static void unary8(Emitter *e, uint8_t opcode, int digit, int reg) {
+    rex(e, 0, 0, reg);
+    emit(e, opcode);
+    modrm(e, 3, digit, reg);
+}
+
+static void movImm8(Emitter *e, int reg, uint8_t imm) {
+    rex(e, 0, 0, reg);
+    emit(e, 0xb0 | (reg & 7));
+    emit(e, imm);
+}
+
+// movzx reg32, byte [rdi + offset]
+static void loadState8(Emitter *e, int reg, size_t offset) {
+    rex(e, 0, reg, 7);
+    emit(e, 0x0f);
+    emit(e, 0xb6);
+    modrm(e, 2, reg, 7);
+    emit32(e, (uint32_t)offset);
+}
+
+// mov byte [rdi + offset], reg8
+static void storeState8(Emitter *e, int reg, size_t offset) {
+    rex(e, 0, reg, 7);
+    emit(e, 0x88);
+    modrm(e, 2, reg, 7);
+    emit32(e, (uint32_t)offset);
+}
+
+// ecx = the address in a register pair
+static void pairAddress(Emitter *e, int high, int low) {
+    rex(e, 0, HOST_CX, high); // movzx ecx, high
+    emit(e, 0x0f);
+    emit(e, 0xb6);
+    modrm(e, 3, HOST_CX, high);
+    emit(e, 0xc1); // shl ecx, 8
+    emit(e, 0xe1);
+    emit(e, 0x08);
+    rex(e, 0, HOST_DX, low); // movzx edx, low
+    emit(e, 0x0f);
+    emit(e, 0xb6);
+    modrm(e, 3, HOST_DX, low);
+    emit(e, 0x09); // or ecx, edx
+    emit(e, 0xd1);
+}
+
+static void immediateAddress(Emitter *e, uint16_t address) {
+    emit(e, 0xb9); // mov ecx, imm32
+    emit32(e, address);
+}
+
+// rdx = the page of the address in ecx from the page table at offset, and
+// ecx = the offset of the address into it
+static void lookupPage(Emitter *e, size_t table) {
+    emit(e, 0x0f); // movzx edx, ch
+    emit(e, 0xb6);
+    emit(e, 0xd5);
+    emit(e, 0x0f); // movzx ecx, cl
+    emit(e, 0xb6);
+    emit(e, 0xc9);
+    emit(e, 0x48); // mov rdx, [rdi + rdx * 8 + table]
+    emit(e, 0x8b);
+    emit(e, 0x94);
+    emit(e, 0xd7);
+    emit32(e, (uint32_t)table);
+}
+
+// reads the byte at the address in ecx into reg
+static void readMemory(Emitter *e, int reg) {
+    lookupPage(e, offsetof(State, readPages));
+    emit(e, 0x0f); // movzx eax, byte [rdx + rcx]
+    emit(e, 0xb6);
+    emit(e, 0x04);
+    emit(e, 0x0a);
+    if (reg != HOST_AX) {
+        regReg8(e, 0x88, reg, HOST_AX);
+    }
+}
+
+// writes reg to the address in ecx. A page with no write pointer stops the
+// block before the instruction at pc, which has taken cycles so far
+static void writeMemory(Emitter *e, int reg, uint16_t pc, uint32_t cycles) {
+    lookupPage(e, offsetof(State, writePages));
+    emit(e, 0x48); // test rdx, rdx
+    emit(e, 0x85);
+    emit(e, 0xd2);
+
+    static const uint8_t jz[] = {0x0f, 0x84};
+    if (e->bailCount < MAX_FIXUPS) {
+        Fixup *bail = &e->bails[e->bailCount++];
+        bail->at = emitJump(e, jz, sizeof(jz));
+        bail->pc = pc;
+        bail->cycles = cycles;
+    } else {
+        e->overflow = 1;
+    }
+
+    rex(e, 0, reg, 0); // mov [rdx + rcx], reg
+    emit(e, 0x88);
+    modrm(e, 0, reg, 4);
+    emit(e, 0x0a);
+}
+
+// FLAGS -- lahf puts SF, ZF, AF, PF and CF into ah in exactly the positions
+// of the 8080 PSW, with bit 1 set. Only the aux carry needs fixing: x86 sets
+// AF on a borrow where the 8080 sets AC when there is none, and the logical
+// instructions have their own rules
+
+#define FLAGS_ADD 0   // add, adc, inr
+#define FLAGS_SUB 1   // sub, sbb, cmp, dcr
+#define FLAGS_LOGIC 2 // ora, xra clear the carry and aux carry
+#define FLAGS_AND 3   // ana, with the aux carry already worked out in cl
+
+static void storeFlags(Emitter *e, int kind) {
+    emit(e, 0x9f); // lahf
+    emit(e, 0x0f); // movzx eax, ah
+    emit(e, 0xb6);
+    emit(e, 0xc4);
+
+    switch (kind) {
+    case FLAGS_SUB:
+        emit(e, 0x34); // xor al, AC_FLAG
+        emit(e, AC_FLAG);
+        break;
+    case FLAGS_LOGIC:
+        emit(e, 0x24); // and al, ~(AC_FLAG | CY_FLAG)
+        emit(e, (uint8_t) ~(AC_FLAG | CY_FLAG));
+        break;
+    case FLAGS_AND:
+        emit(e, 0x24);
+        emit(e, (uint8_t) ~(AC_FLAG | CY_FLAG));
+        emit(e, 0x08); // or al, cl
+        emit(e, 0xc8);
+        break;
+    }
+
+    regReg8(e, 0x88, HOST_F, HOST_AX);
+}
+
+// sets the host carry to the 8080 carry, for adc, sbb, inr, dcr and the
+// rotates through the carry
+static void loadCarry(Emitter *e) {
+    rex(e, 0, 0, HOST_F); // bt r15d, 0
+    emit(e, 0x0f);
+    emit(e, 0xba);
+    modrm(e, 3, 4, HOST_F);
+    emit(e, 0x00);
+}
+
+// copies the host carry into the 8080 carry and leaves the other flags alone
+static void storeCarry(Emitter *e) {
+    emit(e, 0x0f); // setc cl
+    emit(e, 0x92);
+    emit(e, 0xc1);
+    regImm8(e, 4, HOST_F, (uint8_t)~CY_FLAG);
+    regReg8(e, 0x08, HOST_F, HOST_CX);
+}
+
+// ALU instruction with its operand in src. The 8080 ALU opcodes are in the
+// same order as the x86 ones: add, adc, sub, sbb, ana, xra, ora, cmp
+static void alu(Emitter *e, int operation, int src) {
+    static const uint8_t x86Opcode[8] = {0x00, 0x10, 0x28, 0x18,
+                                         0x20, 0x30, 0x08, 0x38};
+    static const int flagKind[8] = {FLAGS_ADD,   FLAGS_ADD,  FLAGS_SUB,
+                                    FLAGS_SUB,   FLAGS_AND,  FLAGS_LOGIC,
+                                    FLAGS_LOGIC, FLAGS_SUB};
+
+    if (operation == 1 || operation == 3) {
+        loadCarry(e);
+    }
+    if (operation == 4) {
+        // the 8080 sets the aux carry to bit 3 of a | src
+        regReg8(e, 0x88, HOST_CX, HOST_A);
+        regReg8(e, 0x08, HOST_CX, src);
+        regImm8(e, 4, HOST_CX, 0x08);
+        regReg8(e, 0x00, HOST_CX, HOST_CX);
+    }
+
+    regReg8(e, x86Opcode[operation], HOST_A, src);
+    storeFlags(e, flagKind[operation]);
+}
+
+// stores the pc and adds the cycles, then leaves through the epilogue with
+// result in eax
+static void emitExit(Emitter *e, uint16_t pc, uint32_t cycles, int result) {
+    emit(e, 0x66); // mov word [rdi + pc], imm16
+    emit(e, 0xc7);
+    emit(e, 0x87);
+    emit32(e, (uint32_t)offsetof(State, pc));
+    emit16(e, pc);
+
+    emit(e, 0x48); // add qword [rdi + cycles], imm32
+    emit(e, 0x81);
+    emit(e, 0x87);
+    emit32(e, (uint32_t)offsetof(State, cycles));
+    emit32(e, cycles);
+
+    emit(e, 0xb8); // mov eax, result
+    emit32(e, result);
+
+    static const uint8_t jmp[] = {0xe9};
+    if (e->epilogueJumpCount < MAX_FIXUPS) {
+        e->epilogueJumps[e->epilogueJumpCount++] =
+            emitJump(e, jmp, sizeof(jmp));
+    } else {
+        e->overflow = 1;
+    }
+}
+
+// what compileInstruction did with an instruction
+#define NOT_COMPILED 0
+#define COMPILED 1
+#define COMPILED_EXIT 2 // a jump, which has emitted the exits of the block
+
+// compiles the instruction at pc, which starts after cycles of the block
+static int compileInstruction(Emitter *e, const MicroOp *op, uint16_t pc,
+                              uint32_t cycles) {
+    uint8_t opcode = op->opcode;
+    uint8_t low = op->operand & 0xff;
+    uint8_t high = op->operand >> 8;
+    uint32_t after = cycles + cycleTable[opcode];
+
+    // MOV, with HLT in the middle of it
+    if (opcode >= 0x40 && opcode < 0x80 && opcode != 0x76) {
+        int dst = hostRegister[(opcode >> 3) & 7];
+        int src = hostRegister[opcode & 7];
+        if (src < 0) {
+            pairAddress(e, hostRegister[4], hostRegister[5]);
+            readMemory(e, dst);
+        } else if (dst < 0) {
+            pairAddress(e, hostRegister[4], hostRegister[5]);
+            writeMemory(e, src, pc, cycles);
+        } else if (dst != src) {
+            regReg8(e, 0x88, dst, src);
+        }
+        return COMPILED;
+    }
+
+    // ALU instructions on a register or memory
+    if (opcode >= 0x80 && opcode < 0xc0) {
+        int src = hostRegister[opcode & 7];
+        if (src < 0) {
+            pairAddress(e, hostRegister[4], hostRegister[5]);
+            readMemory(e, HOST_DX);
+            src = HOST_DX;
+        }
+        alu(e, (opcode >> 3) & 7, src);
+        return COMPILED;
+    }
+
+    // ALU instructions on an immediate
+    if (opcode >= 0xc0 && (opcode & 0x07) == 0x06) {
+        movImm8(e, HOST_DX, low);
+        alu(e, (opcode >> 3) & 7, HOST_DX);
+        return COMPILED;
+    }
+
+    // MVI, INR and DCR on a register
+    if (opcode < 0x40 && (opcode & 0x07) >= 0x04 && (opcode & 0x07) <= 0x06) {
+        int reg = hostRegister[(opcode >> 3) & 7];
+        if (reg < 0) {
+            if ((opcode & 0x07) != 0x06) {
+                return NOT_COMPILED; // INR M and DCR M
+            }
+            movImm8(e, HOST_AX, low);
+            pairAddress(e, hostRegister[4], hostRegister[5]);
+            writeMemory(e, HOST_AX, pc, cycles);
+        } else if ((opcode & 0x07) == 0x06) {
+            movImm8(e, reg, low);
+        } else {
+            int decrement = opcode & 0x01;
+            loadCarry(e);
+            unary8(e, 0xfe, decrement, reg);
+            storeFlags(e, decrement ? FLAGS_SUB : FLAGS_ADD);
+        }
+        return COMPILED;
+    }
+
+    switch (opcode) {
+    case 0x00: // NOP
+        return COMPILED;
+
+    case 0x01: // LXI B, D and H
+    case 0x11:
+    case 0x21: {
+        int pair = opcode >> 4;
+        movImm8(e, hostRegister[pair * 2], high);
+        movImm8(e, hostRegister[pair * 2 + 1], low);
+        return COMPILED;
+    }
+    case 0x31: // LXI SP
+        emit(e, 0x66); // mov word [rdi + sp], imm16
+        emit(e, 0xc7);
+        emit(e, 0x87);
+        emit32(e, (uint32_t)offsetof(State, sp));
+        emit16(e, op->operand);
+        return COMPILED;
+
+    case 0x03: // INX and DCX B, D and H, as a carry into the high byte
+    case 0x13:
+    case 0x23:
+    case 0x0b:
+    case 0x1b:
+    case 0x2b: {
+        int pair = opcode >> 4;
+        int decrement = (opcode & 0x08) != 0;
+        regImm8(e, decrement ? 5 : 0, hostRegister[pair * 2 + 1], 1);
+        regImm8(e, decrement ? 3 : 2, hostRegister[pair * 2], 0);
+        return COMPILED;
+    }
+    case 0x33: // INX SP and DCX SP
+    case 0x3b:
+        emit(e, 0x66); // inc or dec word [rdi + sp]
+        emit(e, 0xff);
+        modrm(e, 2, opcode == 0x3b, 7);
+        emit32(e, (uint32_t)offsetof(State, sp));
+        return COMPILED;
+
+    case 0x02: // STAX B and D
+    case 0x12:
+        pairAddress(e, hostRegister[(opcode >> 4) * 2],
+                    hostRegister[(opcode >> 4) * 2 + 1]);
+        writeMemory(e, HOST_A, pc, cycles);
+        return COMPILED;
+    case 0x0a: // LDAX B and D
+    case 0x1a:
+        pairAddress(e, hostRegister[(opcode >> 4) * 2],
+                    hostRegister[(opcode >> 4) * 2 + 1]);
+        readMemory(e, HOST_A);
+        return COMPILED;
+
+    case 0x32: // STA
+        immediateAddress(e, op->operand);
+        writeMemory(e, HOST_A, pc, cycles);
+        return COMPILED;
+    case 0x3a: // LDA
+        immediateAddress(e, op->operand);
+        readMemory(e, HOST_A);
+        return COMPILED;
+    case 0x22: // SHLD, writing L again is harmless if H stops the block
+        immediateAddress(e, op->operand);
+        writeMemory(e, hostRegister[5], pc, cycles);
+        immediateAddress(e, (uint16_t)(op->operand + 1));
+        writeMemory(e, hostRegister[4], pc, cycles);
+        return COMPILED;
+    case 0x2a: // LHLD
+        immediateAddress(e, op->operand);
+        readMemory(e, hostRegister[5]);
+        immediateAddress(e, (uint16_t)(op->operand + 1));
+        readMemory(e, hostRegister[4]);
+        return COMPILED;
+
+    case 0x07: // RLC, RRC, RAL and RAR only change the carry
+    case 0x0f:
+    case 0x17:
+    case 0x1f: {
+        int digit = opcode >> 3; // rol, ror, rcl and rcr
+        if (digit >= 2) {
+            loadCarry(e);
+        }
+        unary8(e, 0xd0, digit, HOST_A);
+        storeCarry(e);
+        return COMPILED;
+    }
+    case 0x2f: // CMA
+        unary8(e, 0xf6, 2, HOST_A);
+        return COMPILED;
+    case 0x37: // STC
+        regImm8(e, 1, HOST_F, CY_FLAG);
+        return COMPILED;
+    case 0x3f: // CMC
+        regImm8(e, 6, HOST_F, CY_FLAG);
+        return COMPILED;
+
+    case 0xeb: // XCHG
+        regReg8(e, 0x86, hostRegister[2], hostRegister[4]);
+        regReg8(e, 0x86, hostRegister[3], hostRegister[5]);
+        return COMPILED;
+
+    case 0xf3: // DI and EI
+    case 0xfb:
+        emit(e, 0xc6); // mov byte [rdi + interruptEnabled], imm8
+        emit(e, 0x87);
+        emit32(e, (uint32_t)offsetof(State, interruptEnabled));
+        emit(e, opcode == 0xfb);
+        return COMPILED;
+
+    case 0xc3: // JMP
+        emitExit(e, op->operand, after, 0);
+        return COMPILED_EXIT;
+
+    case 0xc2: // conditional jumps
+    case 0xca:
+    case 0xd2:
+    case 0xda:
+    case 0xe2:
+    case 0xea:
+    case 0xf2:
+    case 0xfa: {
+        static const uint8_t conditionFlag[4] = {Z_FLAG, CY_FLAG, P_FLAG,
+                                                 S_FLAG};
+        int whenSet = (opcode & 0x08) != 0;
+
+        rex(e, 0, 0, HOST_F); // test r15b, flag
+        emit(e, 0xf6);
+        modrm(e, 3, 0, HOST_F);
+        emit(e, conditionFlag[(opcode >> 4) & 3]);
+
+        // jnz or jz to the taken exit
+        uint8_t jcc[] = {0x0f, whenSet ? 0x85 : 0x84};
+        size_t taken = emitJump(e, jcc, sizeof(jcc));
+        emitExit(e, (uint16_t)(pc + 3), after, 0);
+        patch(e, taken);
+        emitExit(e, op->operand, after, 0);
+        return COMPILED_EXIT;
+    }
+    }
+
+    return NOT_COMPILED;
+}
+
+// maps the arena the first time a block is compiled. Returns 0 if it can't be
+// mapped, and the blocks are interpreted from then on
+static int mapJitArena(BlockCache *cache) {
+    if (cache->jitArena == MAP_FAILED) {
+        return 0;
+    }
+    if (cache->jitArena == NULL) {
+        cache->jitArena = mmap(NULL, JIT_ARENA_SIZE,
+                               PROT_READ | PROT_WRITE | PROT_EXEC,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (cache->jitArena == MAP_FAILED) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void compileBlock(State *state, Block *block) {
+    BlockCache *cache = state->blockCache;
+    if (!mapJitArena(cache)) {
+        return;
+    }
+
+    Emitter emitter;
+    Emitter *e = &emitter;
+    e->size = 0;
+    e->overflow = 0;
+    e->bailCount = 0;
+    e->epilogueJumpCount = 0;
+
+    // push r12-r15 and load the 8080 registers
+    for (int reg = 12; reg <= 15; reg++) {
+        emit(e, 0x41);
+        emit(e, 0x50 | (reg & 7));
+    }
+    for (int reg = 8; reg <= 15; reg++) {
+        loadState8(e, reg, registerOffset[reg - 8]);
+    }
+
+    uint16_t pc = block->start;
+    uint32_t cycles = 0;
+    int compiled = 0;
+    int result = COMPILED;
+    for (int i = 0; i < block->count; i++) {
+        const MicroOp *op = &block->ops[i];
+        result = compileInstruction(e, op, pc, cycles);
+        if (result == NOT_COMPILED) {
+            break;
+        }
+        compiled++;
+        pc += instructionLength[op->opcode];
+        cycles += cycleTable[op->opcode];
+        if (result == COMPILED_EXIT) {
+            break;
+        }
+    }
+    if (compiled == 0) {
+        return;
+    }
+
+    // a block that didn't end with a jump carries on at pc, or stops there
+    // for the interpreter
+    if (result != COMPILED_EXIT) {
+        emitExit(e, pc, cycles, result == NOT_COMPILED);
+    }
+    for (int i = 0; i < e->bailCount; i++) {
+        patch(e, e->bails[i].at);
+        emitExit(e, e->bails[i].pc, e->bails[i].cycles, 1);
+    }
+
+    // store the 8080 registers and pop r15-r12
+    for (int i = 0; i < e->epilogueJumpCount; i++) {
+        patch(e, e->epilogueJumps[i]);
+    }
+    for (int reg = 8; reg <= 15; reg++) {
+        storeState8(e, reg, registerOffset[reg - 8]);
+    }
+    for (int reg = 15; reg >= 12; reg--) {
+        emit(e, 0x41);
+        emit(e, 0x58 | (reg & 7));
+    }
+    emit(e, 0xc3); // ret
+
+    if (e->overflow || cache->jitUsed + e->size > JIT_ARENA_SIZE) {
+        return;
+    }
+    uint8_t *code = cache->jitArena + cache->jitUsed;
+    memcpy(code, e->code, e->size);
+    cache->jitUsed += (e->size + 15) & ~(size_t)15;
+    block->native = (NativeBlock)code;
+}
+
+void freeJitArena(BlockCache *cache) {
+    if (cache->jitArena != NULL && cache->jitArena != MAP_FAILED) {
+        munmap(cache->jitArena, JIT_ARENA_SIZE);
+    }
+    cache->jitArena = NULL;
+}
+
+#else
+
+void compileBlock(State *state, Block *block) {}
+
+void freeJitArena(BlockCache *cache) {}
+
+#endif
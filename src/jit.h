@@ -0,0 +1,30 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "blocks.h"
+#include "cpu.h"
+
+// JIT -- the jit engine is the block engine, but a block that has run
+// JIT_THRESHOLD times is compiled into x86-64 code. The compiled code keeps
+// the 8080 registers in host registers and reads memory through the page
+// table itself. It stops before any instruction it can't compile, such as IN,
+// OUT and the stack instructions, and before any write to a page without a
+// write pointer, which covers pages with cached code and hardware behind
+// them. The engine then runs that one instruction with Emulate()
+//
+// Without x86-64, or when the code arena can't be mapped executable, no block
+// is ever compiled and the jit engine is just the block engine
+
+#define JIT_THRESHOLD 16
+
+// bytes of compiled code each state can hold. Flushing the block cache throws
+// the code away too
+#define JIT_ARENA_SIZE (4 << 20)
+
+// compiles the block into block->native, which stays NULL if none of the
+// block could be compiled
+void compileBlock(State *state, Block *block);
+
+void freeJitArena(BlockCache *cache);
+
+#endif
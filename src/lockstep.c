@@ -0,0 +1,564 @@
+#include "lockstep.h"
+
+#include "blocks.h"
+#include "machine.h"
+#include "memory.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+
+// the helpers are inlined into both builds of runLanes below, so each gets
+// them compiled for its own instruction set
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
+// one 16 bit lane per machine. 8 bit registers only ever use the low byte
+typedef uint16_t Lanes __attribute__((vector_size(LOCKSTEP_LANES * 2)));
+typedef int16_t Budgets __attribute__((vector_size(LOCKSTEP_LANES * 2)));
+
+// the register codes in bits 0-2 and 3-5 of the opcodes, which index
+// registers. Code 6 is the memory at HL
+#define REGISTER_B 0
+#define REGISTER_C 1
+#define REGISTER_D 2
+#define REGISTER_E 3
+#define REGISTER_H 4
+#define REGISTER_L 5
+#define REGISTER_M 6
+#define REGISTER_A 7
+
+// the register pair codes in bits 4-5, PAIR_SP is PSW for PUSH and POP
+#define PAIR_SP 3
+
+// how far ahead of the machine furthest behind the others can get, see
+// chooseLeader
+#define LOCKSTEP_SLACK 1000
+
+typedef struct Lockstep {
+    State **states;
+    int count;
+
+    Lanes registers[8];
+    Lanes flags;
+    Lanes sp;
+    Lanes pc;
+    // cycles each machine has left to run to the next interrupt, machines
+    // with none left and lanes with no machine sit out every step
+    Budgets left;
+    uint64_t due[LOCKSTEP_LANES]; // the cycle count of that interrupt
+
+    // set for the ROM pages that are the same memory for every machine, where
+    // they can't be running different code
+    uint8_t sharedPages[PAGE_COUNT];
+
+    // instructions each lane ran as part of a vector since the interrupt
+    Lanes vectorInstructions;
+    LockstepStats stats;
+} Lockstep;
+
+static void loadLane(Lockstep *lockstep, int lane) {
+    State *state = lockstep->states[lane];
+    lockstep->registers[REGISTER_B][lane] = state->b;
+    lockstep->registers[REGISTER_C][lane] = state->c;
+    lockstep->registers[REGISTER_D][lane] = state->d;
+    lockstep->registers[REGISTER_E][lane] = state->e;
+    lockstep->registers[REGISTER_H][lane] = state->h;
+    lockstep->registers[REGISTER_L][lane] = state->l;
+    lockstep->registers[REGISTER_A][lane] = state->a;
+    lockstep->flags[lane] = state->flags;
+    lockstep->sp[lane] = state->sp;
+    lockstep->pc[lane] = state->pc;
+    lockstep->left[lane] = (int16_t)(lockstep->due[lane] - state->cycles);
+}
+
+static void storeLane(Lockstep *lockstep, int lane) {
+    State *state = lockstep->states[lane];
+    state->b = lockstep->registers[REGISTER_B][lane];
+    state->c = lockstep->registers[REGISTER_C][lane];
+    state->d = lockstep->registers[REGISTER_D][lane];
+    state->e = lockstep->registers[REGISTER_E][lane];
+    state->h = lockstep->registers[REGISTER_H][lane];
+    state->l = lockstep->registers[REGISTER_L][lane];
+    state->a = lockstep->registers[REGISTER_A][lane];
+    state->flags = lockstep->flags[lane];
+    state->sp = lockstep->sp[lane];
+    state->pc = lockstep->pc[lane];
+    state->cycles = lockstep->due[lane] - lockstep->left[lane];
+}
+
+// VECTOR OPERATIONS -- the same work as the ALU helpers in cpu.c, which take
+// a single State, done on every lane at once. The flags are worked out with
+// arithmetic instead of the tables cpu.c looks them up in, as there is no
+// cheap way to look up 16 entries at once
+
+ALWAYS_INLINE Lanes broadcast(uint16_t value) {
+    Lanes lanes = {0};
+    return lanes + value;
+}
+
+// value in the lanes of mask, and old everywhere else
+ALWAYS_INLINE Lanes blend(Lanes mask, Lanes value, Lanes old) {
+    return (value & mask) | (old & ~mask);
+}
+
+ALWAYS_INLINE Lanes zspFlags(Lanes value) {
+    Lanes parity = value ^ (value >> 4);
+    parity ^= parity >> 2;
+    parity ^= parity >> 1;
+    return (value & S_FLAG) | ((Lanes)(value == 0) & Z_FLAG) |
+           ((~parity & 1) << 2);
+}
+
+// runs ADD, ADC, SUB, SBB, ANA, XRA, ORA or CMP, numbered as in bits 3-5 of
+// the opcode. The carry is bit 8 of the 16 bit result as in cpu.c, and the
+// aux carry is the carry into bit 4, which is inverted for a subtraction as
+// the 8080 adds the complement
+ALWAYS_INLINE void alu(Lockstep *lockstep, Lanes mask, int operation,
+                       Lanes value) {
+    Lanes a = lockstep->registers[REGISTER_A];
+    Lanes carry = lockstep->flags & CY_FLAG;
+    Lanes result;
+    Lanes flags;
+
+    switch (operation) {
+    case 0:
+    case 1:
+        result = a + value + (operation == 1 ? carry : broadcast(0));
+        flags = ((a ^ value ^ result) & AC_FLAG) | ((result >> 8) & CY_FLAG);
+        break;
+    case 2:
+    case 3:
+    case 7:
+        result = a - value - (operation == 3 ? carry : broadcast(0));
+        flags = (~(a ^ value ^ result) & AC_FLAG) | ((result >> 8) & CY_FLAG);
+        break;
+    case 4:
+        result = a & value;
+        flags = ((a | value) & 0x08) << 1;
+        break;
+    case 5:
+        result = a ^ value;
+        flags = broadcast(0);
+        break;
+    default:
+        result = a | value;
+        flags = broadcast(0);
+        break;
+    }
+
+    result &= 0xff;
+    lockstep->flags =
+        blend(mask, flags | zspFlags(result) | PSW_FIXED_BITS, lockstep->flags);
+    if (operation != 7) {
+        lockstep->registers[REGISTER_A] = blend(mask, result, a);
+    }
+}
+
+// INR and DCR keep the carry and set the aux carry on a carry out of, or no
+// borrow from, the low nibble
+ALWAYS_INLINE Lanes step8(Lockstep *lockstep, Lanes mask, Lanes value,
+                          int decrement) {
+    Lanes result = (value + (uint16_t)(decrement ? 0xff : 1)) & 0xff;
+    Lanes auxCarry = decrement ? (Lanes)((result & 0x0f) != 0x0f)
+                               : (Lanes)((result & 0x0f) == 0);
+    lockstep->flags = blend(mask,
+                            (lockstep->flags & CY_FLAG) | zspFlags(result) |
+                                (auxCarry & AC_FLAG) | PSW_FIXED_BITS,
+                            lockstep->flags);
+    return result;
+}
+
+// the lanes where condition code condition holds, numbered as in bits 3-5 of
+// the opcode: NZ Z NC C PO PE P M
+ALWAYS_INLINE Lanes conditionMet(const Lockstep *lockstep, int condition) {
+    static const uint8_t conditionFlags[4] = {Z_FLAG, CY_FLAG, P_FLAG,
+                                              S_FLAG};
+    Lanes flag = lockstep->flags & conditionFlags[condition >> 1];
+    Lanes set = (Lanes)(flag != 0);
+    return condition & 1 ? set : ~set;
+}
+
+ALWAYS_INLINE Lanes readPair(const Lockstep *lockstep, int pair) {
+    if (pair == PAIR_SP) {
+        return lockstep->sp;
+    }
+    return (lockstep->registers[pair * 2] << 8) |
+           lockstep->registers[pair * 2 + 1];
+}
+
+ALWAYS_INLINE void writePair(Lockstep *lockstep, Lanes mask, int pair,
+                             Lanes value) {
+    if (pair == PAIR_SP) {
+        lockstep->sp = blend(mask, value, lockstep->sp);
+        return;
+    }
+    lockstep->registers[pair * 2] =
+        blend(mask, value >> 8, lockstep->registers[pair * 2]);
+    lockstep->registers[pair * 2 + 1] =
+        blend(mask, value & 0xff, lockstep->registers[pair * 2 + 1]);
+}
+
+// every machine has its own memory, so loads and stores go through the page
+// table of each lane in turn
+
+ALWAYS_INLINE Lanes loadBytes(Lockstep *lockstep, Lanes mask,
+                              Lanes addresses) {
+    Lanes values = {0};
+    for (int lane = 0; lane < lockstep->count; lane++) {
+        if (mask[lane]) {
+            values[lane] = readByte(lockstep->states[lane], addresses[lane]);
+        }
+    }
+    return values;
+}
+
+ALWAYS_INLINE void storeBytes(Lockstep *lockstep, Lanes mask,
+                              Lanes addresses, Lanes values) {
+    for (int lane = 0; lane < lockstep->count; lane++) {
+        if (mask[lane]) {
+            writeByte(lockstep->states[lane], addresses[lane], values[lane]);
+        }
+    }
+}
+
+ALWAYS_INLINE Lanes readOperand(Lockstep *lockstep, Lanes mask, int code) {
+    if (code == REGISTER_M) {
+        return loadBytes(lockstep, mask, readPair(lockstep, REGISTER_H / 2));
+    }
+    return lockstep->registers[code];
+}
+
+ALWAYS_INLINE void writeOperand(Lockstep *lockstep, Lanes mask, int code,
+                                Lanes value) {
+    if (code == REGISTER_M) {
+        storeBytes(lockstep, mask, readPair(lockstep, REGISTER_H / 2), value);
+    } else {
+        lockstep->registers[code] =
+            blend(mask, value, lockstep->registers[code]);
+    }
+}
+
+// the high byte is written first, as push in cpu.c does
+ALWAYS_INLINE void push(Lockstep *lockstep, Lanes mask, Lanes value) {
+    Lanes sp = blend(mask, lockstep->sp - 2, lockstep->sp);
+    storeBytes(lockstep, mask, sp + 1, value >> 8);
+    storeBytes(lockstep, mask, sp, value & 0xff);
+    lockstep->sp = sp;
+}
+
+ALWAYS_INLINE Lanes pop(Lockstep *lockstep, Lanes mask) {
+    Lanes low = loadBytes(lockstep, mask, lockstep->sp);
+    Lanes high = loadBytes(lockstep, mask, lockstep->sp + 1);
+    lockstep->sp = blend(mask, lockstep->sp + 2, lockstep->sp);
+    return (high << 8) | low;
+}
+
+// runs the instruction on the lanes of mask, which all have their pc at it.
+// Returns 0 for an instruction that has to be run by Emulate
+ALWAYS_INLINE int runVector(Lockstep *lockstep, Lanes mask, uint8_t opcode,
+                            uint16_t operand) {
+    int destination = (opcode >> 3) & 7;
+    int source = opcode & 7;
+    int pair = (opcode >> 4) & 3;
+    Lanes pc = lockstep->pc + instructionLength[opcode];
+    Lanes taken = {0}; // lanes where a conditional call or return was taken
+    Lanes a = lockstep->registers[REGISTER_A];
+    Lanes carry = lockstep->flags & CY_FLAG;
+
+    switch (opcode) {
+    case 0x00: // NOP
+        break;
+    case 0x40 ... 0x75:
+    case 0x77 ... 0x7f: // MOV
+        writeOperand(lockstep, mask, destination,
+                     readOperand(lockstep, mask, source));
+        break;
+    case 0x80 ... 0xbf: // ADD ... CMP
+        alu(lockstep, mask, destination, readOperand(lockstep, mask, source));
+        break;
+    case 0xc6: case 0xce: case 0xd6: case 0xde:
+    case 0xe6: case 0xee: case 0xf6: case 0xfe: // ADI ... CPI
+        alu(lockstep, mask, destination, broadcast(operand & 0xff));
+        break;
+    case 0x06: case 0x0e: case 0x16: case 0x1e:
+    case 0x26: case 0x2e: case 0x36: case 0x3e: // MVI
+        writeOperand(lockstep, mask, destination, broadcast(operand & 0xff));
+        break;
+    case 0x04: case 0x05: case 0x0c: case 0x0d: case 0x14: case 0x15:
+    case 0x1c: case 0x1d: case 0x24: case 0x25: case 0x2c: case 0x2d:
+    case 0x34: case 0x35: case 0x3c: case 0x3d: { // INR and DCR
+        Lanes value = readOperand(lockstep, mask, destination);
+        writeOperand(lockstep, mask, destination,
+                     step8(lockstep, mask, value, opcode & 1));
+        break;
+    }
+    case 0x01: case 0x11: case 0x21: case 0x31: // LXI
+        writePair(lockstep, mask, pair, broadcast(operand));
+        break;
+    case 0x03: case 0x13: case 0x23: case 0x33: // INX
+        writePair(lockstep, mask, pair, readPair(lockstep, pair) + 1);
+        break;
+    case 0x0b: case 0x1b: case 0x2b: case 0x3b: // DCX
+        writePair(lockstep, mask, pair, readPair(lockstep, pair) - 1);
+        break;
+    case 0x0a: case 0x1a: // LDAX
+        lockstep->registers[REGISTER_A] =
+            blend(mask, loadBytes(lockstep, mask, readPair(lockstep, pair)), a);
+        break;
+    case 0x02: case 0x12: // STAX
+        storeBytes(lockstep, mask, readPair(lockstep, pair), a);
+        break;
+    case 0x3a: // LDA
+        lockstep->registers[REGISTER_A] =
+            blend(mask, loadBytes(lockstep, mask, broadcast(operand)), a);
+        break;
+    case 0x32: // STA
+        storeBytes(lockstep, mask, broadcast(operand), a);
+        break;
+    case 0xc3: // JMP
+        pc = broadcast(operand);
+        break;
+    case 0xc2: case 0xca: case 0xd2: case 0xda:
+    case 0xe2: case 0xea: case 0xf2: case 0xfa: // Jcc
+        pc = blend(conditionMet(lockstep, destination), broadcast(operand), pc);
+        break;
+    case 0xcd: // CALL
+        push(lockstep, mask, pc);
+        pc = broadcast(operand);
+        break;
+    case 0xc4: case 0xcc: case 0xd4: case 0xdc:
+    case 0xe4: case 0xec: case 0xf4: case 0xfc: // Ccc
+        taken = mask & conditionMet(lockstep, destination);
+        push(lockstep, taken, pc);
+        pc = blend(taken, broadcast(operand), pc);
+        break;
+    case 0xc9: // RET
+        pc = pop(lockstep, mask);
+        break;
+    case 0xc0: case 0xc8: case 0xd0: case 0xd8:
+    case 0xe0: case 0xe8: case 0xf0: case 0xf8: // Rcc
+        taken = mask & conditionMet(lockstep, destination);
+        pc = blend(taken, pop(lockstep, taken), pc);
+        break;
+    case 0xc5: case 0xd5: case 0xe5: // PUSH
+        push(lockstep, mask, readPair(lockstep, pair));
+        break;
+    case 0xf5: // PUSH PSW
+        push(lockstep, mask, (a << 8) | lockstep->flags);
+        break;
+    case 0xc1: case 0xd1: case 0xe1: // POP
+        writePair(lockstep, mask, pair, pop(lockstep, mask));
+        break;
+    case 0xf1: { // POP PSW
+        Lanes psw = pop(lockstep, mask);
+        lockstep->registers[REGISTER_A] = blend(mask, psw >> 8, a);
+        lockstep->flags = blend(mask, (psw & PSW_FLAGS) | PSW_FIXED_BITS,
+                                lockstep->flags);
+        break;
+    }
+    case 0xeb: { // XCHG
+        Lanes hl = readPair(lockstep, REGISTER_H / 2);
+        writePair(lockstep, mask, REGISTER_H / 2,
+                  readPair(lockstep, REGISTER_D / 2));
+        writePair(lockstep, mask, REGISTER_D / 2, hl);
+        break;
+    }
+    case 0x07: case 0x0f: case 0x17: case 0x1f: { // RLC, RRC, RAL and RAR
+        int right = opcode & 0x08;
+        Lanes out = right ? a & 1 : a >> 7;
+        Lanes in = opcode & 0x10 ? carry : out;
+        Lanes result = right ? (a >> 1) | (in << 7) : ((a << 1) | in) & 0xff;
+        lockstep->registers[REGISTER_A] = blend(mask, result, a);
+        lockstep->flags =
+            blend(mask, (lockstep->flags & ~CY_FLAG) | out, lockstep->flags);
+        break;
+    }
+    case 0x2f: // CMA
+        lockstep->registers[REGISTER_A] = blend(mask, ~a & 0xff, a);
+        break;
+    case 0x37: // STC
+        lockstep->flags |= mask & CY_FLAG;
+        break;
+    case 0x3f: // CMC
+        lockstep->flags ^= mask & CY_FLAG;
+        break;
+    default:
+        return 0;
+    }
+
+    lockstep->pc = blend(mask, pc, lockstep->pc);
+    lockstep->left -= (Budgets)((mask & cycleTable[opcode]) +
+                                (taken & CONDITIONAL_TAKEN_CYCLES));
+    return 1;
+}
+
+// the lanes that still have cycles to run and have their pc at the same
+// instruction as the leader
+ALWAYS_INLINE Lanes sameInstruction(Lockstep *lockstep, int leader,
+                                    uint16_t pc, int length) {
+    Lanes mask = (Lanes)(lockstep->pc == pc) & (Lanes)(lockstep->left > 0);
+    uint16_t last = pc + length - 1;
+    if (lockstep->sharedPages[pc >> PAGE_SHIFT] &&
+        lockstep->sharedPages[last >> PAGE_SHIFT]) {
+        return mask;
+    }
+
+    State *state = lockstep->states[leader];
+    for (int lane = 0; lane < lockstep->count; lane++) {
+        for (int i = 0; mask[lane] && i < length; i++) {
+            uint16_t address = pc + i;
+            if (readByte(lockstep->states[lane], address) !=
+                readByte(state, address)) {
+                mask[lane] = 0;
+            }
+        }
+    }
+    return mask;
+}
+
+// picks the machine to run next, or returns -1 when none has cycles left.
+// Of the machines no more than LOCKSTEP_SLACK cycles ahead of the one
+// furthest behind, it picks the one deepest in calls and then the one with
+// the lowest pc. The others wait for it where they are, and as code mostly
+// runs forward and returns from calls, it tends to come to them. most is
+// set to the cycles the one furthest behind has left
+static int chooseLeader(Lockstep *lockstep, int16_t *most) {
+    *most = 0;
+    for (int lane = 0; lane < lockstep->count; lane++) {
+        if (lockstep->left[lane] > *most) {
+            *most = lockstep->left[lane];
+        }
+    }
+
+    int leader = -1;
+    for (int lane = 0; lane < lockstep->count; lane++) {
+        if (lockstep->left[lane] <= 0 ||
+            lockstep->left[lane] < *most - LOCKSTEP_SLACK) {
+            continue;
+        }
+        if (leader < 0 || lockstep->sp[lane] < lockstep->sp[leader] ||
+            (lockstep->sp[lane] == lockstep->sp[leader] &&
+             lockstep->pc[lane] < lockstep->pc[leader])) {
+            leader = lane;
+        }
+    }
+    return leader;
+}
+
+// runs every lane until it has no cycles left
+ALWAYS_INLINE void runLanes(Lockstep *lockstep) {
+    int leader = -1;
+    int16_t most = 0;
+    for (;;) {
+        // the leader keeps going, taking along the machines that are at the
+        // same instruction, until it is too far ahead of the others. most
+        // can only be more than the cycles the others have left by now, so
+        // it is chosen again at least as often as it has to be
+        if (leader < 0 || lockstep->left[leader] <= 0 ||
+            lockstep->left[leader] < most - LOCKSTEP_SLACK) {
+            leader = chooseLeader(lockstep, &most);
+            if (leader < 0) {
+                return;
+            }
+        }
+
+        State *state = lockstep->states[leader];
+        uint16_t pc = lockstep->pc[leader];
+        uint8_t opcode = readByte(state, pc);
+        uint16_t operand = readByte(state, pc + 1) |
+                           (readByte(state, pc + 2) << 8);
+        Lanes mask =
+            sameInstruction(lockstep, leader, pc, instructionLength[opcode]);
+        lockstep->stats.steps++;
+
+        if (runVector(lockstep, mask, opcode, operand)) {
+            lockstep->vectorInstructions += mask & 1;
+            continue;
+        }
+
+        for (int lane = 0; lane < lockstep->count; lane++) {
+            if (mask[lane]) {
+                storeLane(lockstep, lane);
+                Emulate(lockstep->states[lane]);
+                loadLane(lockstep, lane);
+                lockstep->stats.scalarInstructions++;
+            }
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static void runLanesAvx2(Lockstep *lockstep) {
+    runLanes(lockstep);
+}
+#endif
+
+static void runLanesGeneric(Lockstep *lockstep) {
+    runLanes(lockstep);
+}
+
+void runLockstepFrame(State **states, int count, LockstepStats *stats) {
+    static void (*run)(Lockstep *lockstep) = NULL;
+    if (run == NULL) {
+        run = runLanesGeneric;
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("avx2")) {
+            run = runLanesAvx2;
+        }
+#endif
+    }
+
+    Lockstep lockstep = {0};
+    lockstep.states = states;
+    lockstep.count = count < LOCKSTEP_LANES ? count : LOCKSTEP_LANES;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        lockstep.sharedPages[page] = 1;
+        for (int lane = 0; lane < lockstep.count; lane++) {
+            // only ROM pages mapped to the same data are shared. RAM never
+            // is, not even the pages forks still share, as any machine could
+            // write to it and change the code the others run
+            if (states[lane]->readPages[page] != states[0]->readPages[page] ||
+                states[lane]->writePages[page] != states[lane]->discardPage) {
+                lockstep.sharedPages[page] = 0;
+            }
+        }
+    }
+
+    int rsts[LOCKSTEP_LANES];
+    for (int half = 0; half < 2; half++) {
+        for (int lane = 0; lane < lockstep.count; lane++) {
+            lockstep.due[lane] =
+                nextInterrupt(states[lane]->cycles, &rsts[lane]);
+            loadLane(&lockstep, lane);
+        }
+
+        lockstep.vectorInstructions = broadcast(0);
+        run(&lockstep);
+        for (int lane = 0; lane < lockstep.count; lane++) {
+            lockstep.stats.instructions += lockstep.vectorInstructions[lane];
+        }
+
+        // each machine is interrupted at its own due cycle, as in runFrame
+        for (int lane = 0; lane < lockstep.count; lane++) {
+            storeLane(&lockstep, lane);
+            GenerateInterrupt(states[lane], rsts[lane]);
+        }
+    }
+
+    lockstep.stats.instructions += lockstep.stats.scalarInstructions;
+    if (stats != NULL) {
+        stats->steps += lockstep.stats.steps;
+        stats->instructions += lockstep.stats.instructions;
+        stats->scalarInstructions += lockstep.stats.scalarInstructions;
+    }
+}
+
+#else
+
+// without vector extensions every machine runs its frame on its own
+void runLockstepFrame(State **states, int count, LockstepStats *stats) {
+    for (int lane = 0; lane < count && lane < LOCKSTEP_LANES; lane++) {
+        runFrame(states[lane], findEngine("threaded"));
+    }
+    (void)stats;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+// LOCKSTEP -- runs a group of machines together, with their registers stored
+// as one vector per register holding a lane for every machine. Each step
+// runs the next instruction of one machine, and every machine whose pc
+// points at the same instruction runs it in the same vector operation, so
+// machines running the same ROM mostly cost one instruction between them.
+// Machines that went different ways wait for each other to come back to the
+// same code, see chooseLeader in lockstep.c. Register and flag instructions,
+// jumps, and loads, stores, calls and returns through each machine's own
+// memory run as vectors. Anything else (IN, OUT, DAD, DAA, EI, ...) runs on
+// each machine in turn through Emulate. The vectors use AVX2 when the cpu
+// has it, and whatever the compiler generates for the target otherwise
+#define LOCKSTEP_LANES 16
+
+typedef struct LockstepStats {
+    uint64_t steps; // instructions run across lanes at once or on their own
+    uint64_t instructions; // instructions run by all the machines together
+    uint64_t scalarInstructions; // of those, run on their own by Emulate
+} LockstepStats;
+
+// runs every machine for a frame, with the same interrupts at the same cycles
+// as runFrame, so each ends up exactly where runFrame would have left it.
+// count is at most LOCKSTEP_LANES. stats can be NULL, otherwise the counts
+// are added to it
+void runLockstepFrame(State **states, int count, LockstepStats *stats);
+
+#endif
@@ -0,0 +1,105 @@
+#include "machine.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "memory.h"
+#include "ports.h"
+
+State *setupSpaceInvaders(const Rom *roms, const uint16_t *addresses,
+                          int count) {
+    State *state = setupStateMachine();
+
+    // write protects the ROM and mirrors the RAM, then maps the ROM files
+    // straight over the ROM pages
+    mapSpaceInvaders(state);
+    mapSpaceInvadersPorts(state);
+    for (int i = 0; i < count; i++) {
+        mapRomImage(state, &roms[i], addresses[i]);
+    }
+
+    state->pc = 0x0000;
+    state->sp = 0x2400;
+    state->interruptEnabled = 0;
+    return state;
+}
+
+uint64_t nextInterrupt(uint64_t cycles, int *rst) {
+    uint64_t start = cycles / CYCLES_PER_FRAME * CYCLES_PER_FRAME;
+    uint64_t middle = start + CYCLES_PER_FRAME / 2;
+    if (cycles < middle) {
+        *rst = MID_FRAME_RST;
+        return middle;
+    }
+    *rst = END_FRAME_RST;
+    return start + CYCLES_PER_FRAME;
+}
+
+void runFrame(State *state, const Engine *engine) {
+    for (int half = 0; half < 2; half++) {
+        int rst;
+        uint64_t due = nextInterrupt(state->cycles, &rst);
+        engine->run(state, (int)(due - state->cycles));
+        GenerateInterrupt(state, rst);
+    }
+}
+
+static int64_t nanoseconds(const struct timespec *time) {
+    return (int64_t)time->tv_sec * 1000000000L + time->tv_nsec;
+}
+
+static struct timespec timespecFrom(int64_t nanoseconds) {
+    struct timespec time = {nanoseconds / 1000000000L,
+                            nanoseconds % 1000000000L};
+    return time;
+}
+
+void startPacer(FramePacer *pacer, State *state, int turbo) {
+    pacer->turbo = turbo;
+    clock_gettime(CLOCK_MONOTONIC, &pacer->start);
+    pacer->startCycles = state->cycles;
+    pacer->reportTime = pacer->start;
+    pacer->reportCycles = state->cycles;
+}
+
+void paceFrame(FramePacer *pacer, State *state) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (pacer->turbo) {
+        int64_t elapsed = nanoseconds(&now) - nanoseconds(&pacer->reportTime);
+        if (elapsed >= 1000000000L) {
+            double emulated =
+                (double)(state->cycles - pacer->reportCycles) *
+                NANOSECONDS_PER_CYCLE;
+            fprintf(stderr, "turbo: %.1fx real time, %.1f MHz\n",
+                    emulated / elapsed,
+                    emulated / elapsed * CPU_CLOCK_HZ / 1e6);
+            pacer->reportTime = now;
+            pacer->reportCycles = state->cycles;
+        }
+        return;
+    }
+
+    int64_t due = nanoseconds(&pacer->start) +
+                  (int64_t)(state->cycles - pacer->startCycles) *
+                      NANOSECONDS_PER_CYCLE;
+    if (nanoseconds(&now) - due > 1000000000L / FRAMES_PER_SECOND) {
+        startPacer(pacer, state, 0);
+        return;
+    }
+
+    // clock_nanosleep returns the error instead of setting errno. A signal
+    // only interrupts the sleep, and the deadline is absolute so it just goes
+    // again. Any other error would fail every time, so the pacer starts
+    // counting again from here instead
+    struct timespec deadline = timespecFrom(due);
+    int error;
+    do {
+        error =
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    } while (error == EINTR);
+    if (error != 0) {
+        startPacer(pacer, state, 0);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <time.h>
+
+#include "cpu.h"
+#include "rom.h"
+
+// SPACE INVADERS TIMING -- the 8080 runs at 2MHz and the screen at 60Hz. The
+// video hardware interrupts with RST 1 when the beam reaches the middle of the
+// screen and with RST 2 when it starts the vertical blank
+#define CPU_CLOCK_HZ 2000000
+#define FRAMES_PER_SECOND 60
+#define CYCLES_PER_FRAME (CPU_CLOCK_HZ / FRAMES_PER_SECOND)
+#define MID_FRAME_RST 1
+#define END_FRAME_RST 2
+
+// sets up a space invaders machine: the memory map and ports, with each ROM
+// mapped at its address, pc at 0 and the stack below video RAM. The ROMs
+// stay owned by the caller, and any number of machines can share them, as
+// their ROM pages point straight at the mapped files
+State *setupSpaceInvaders(const Rom *roms, const uint16_t *addresses,
+                          int count);
+
+// returns the cycle the next interrupt after cycles is due at, and sets rst
+// to the one it is. Frame n starts at n * CYCLES_PER_FRAME, RST 1 is due
+// CYCLES_PER_FRAME / 2 into it and RST 2 at its end, so a frame is exactly
+// CYCLES_PER_FRAME cycles long
+uint64_t nextInterrupt(uint64_t cycles, int *rst);
+
+// runs the cpu for one frame with the engine, interrupting at the middle and
+// at the end of the frame. The interrupts are due at fixed cycles, see
+// nextInterrupt, so the few cycles the engine runs past the budget never add
+// up over many frames
+void runFrame(State *state, const Engine *engine);
+
+// PACING -- in real time the machine sleeps after each frame until the wall
+// clock has caught up with the cycles it has run, 500ns for each cycle at
+// 2MHz, so there is no drift however long it runs. A machine that falls more
+// than a frame behind starts counting again from where it is, instead of
+// rushing to catch up. Turbo mode never sleeps and reports how much faster
+// than the real machine it is running once a second
+#define NANOSECONDS_PER_CYCLE (1000000000L / CPU_CLOCK_HZ)
+
+typedef struct FramePacer {
+    int turbo;
+    struct timespec start; // wall clock when startCycles were run
+    uint64_t startCycles;
+
+    // the last turbo report
+    struct timespec reportTime;
+    uint64_t reportCycles;
+} FramePacer;
+
+void startPacer(FramePacer *pacer, State *state, int turbo);
+
+// called after every frame, sleeps until the frame is due in real time
+void paceFrame(FramePacer *pacer, State *state);
+
+#endif
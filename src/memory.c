@@ -0,0 +1,62 @@
+#include "memory.h"
+
+// space invaders memory layout
+#define ROM_START 0x0000
+#define ROM_SIZE 0x2000
+#define RAM_START 0x2000
+#define RAM_SIZE 0x2000
+#define MIRROR_START 0x4000
+
+void mapPages(State *state, uint16_t address, uint32_t size, uint8_t *read,
+              uint8_t *write, WriteHandler handler) {
+    int first = address >> PAGE_SHIFT;
+    int count = size >> PAGE_SHIFT;
+
+    for (int i = 0; i < count && first + i < PAGE_COUNT; i++) {
+        state->readPages[first + i] = read + i * PAGE_SIZE;
+        state->writePages[first + i] =
+            write == NULL ? NULL : write + i * PAGE_SIZE;
+        state->writeHandlers[first + i] = handler;
+    }
+}
+
+void mapFlatMemory(State *state) {
+    mapPages(state, 0, MEMORY_SIZE, state->memory, state->memory, NULL);
+}
+
+void mapRom(State *state, uint16_t address, uint32_t size, uint8_t *data) {
+    // nothing past the end of the address space can be mapped
+    uint32_t visible = MEMORY_SIZE - address;
+    if (size > visible) {
+        size = visible;
+    }
+    mapPages(state, address, size, data, NULL, NULL);
+
+    // every page of the ROM writes into the same discard page
+    for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        state->writePages[(address + offset) >> PAGE_SHIFT] =
+            state->discardPage;
+    }
+}
+
+void mapSpaceInvaders(State *state) {
+    mapRom(state, ROM_START, ROM_SIZE, state->memory + ROM_START);
+
+    uint8_t *ram = state->memory + RAM_START;
+    for (uint32_t address = RAM_START; address < MEMORY_SIZE;
+         address += RAM_SIZE) {
+        mapPages(state, address, RAM_SIZE, ram, ram, NULL);
+    }
+}
+
+int ownsPage(State *state, int page) {
+    if (state->writePages[page] == state->discardPage) {
+        return 0;
+    }
+    for (int earlier = 0; earlier < page; earlier++) {
+        if (state->readPages[earlier] == state->readPages[page]) {
+            return 0;
+        }
+    }
+    return 1;
+}
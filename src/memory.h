@@ -0,0 +1,121 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+
+// MEMORY MAP -- the 64KB address space is split into 256 byte pages. Each
+// page has a pointer it is read from and a pointer it is written to, so ROM,
+// RAM and mirrors of RAM all cost a single table lookup:
+// - RAM pages read and write the same bytes of state->memory
+// - ROM pages write to state->discardPage, so writes are thrown away
+// - mirrored pages point at the page they mirror
+// - pages with no write pointer call their write handler instead, for
+//   hardware that has to see the write
+// setupStateMachine maps all 64KB as plain RAM in state->memory
+
+// maps the address range onto the bytes at read and write. A NULL write
+// pointer sends writes in the range to handler
+void mapPages(State *state, uint16_t address, uint32_t size, uint8_t *read,
+              uint8_t *write, WriteHandler handler);
+
+// maps the whole address space as RAM in state->memory
+void mapFlatMemory(State *state);
+
+// maps the address range as ROM holding the bytes at data
+void mapRom(State *state, uint16_t address, uint32_t size, uint8_t *data);
+
+// space invaders: ROM at 0x0000-0x1fff, RAM at 0x2000-0x3fff and mirrors of
+// that RAM from 0x4000 up. The ROM is whatever is in state->memory already
+void mapSpaceInvaders(State *state);
+
+// returns 1 if the page is RAM that isn't a mirror of an earlier page. These
+// are the pages that hold the state of the machine, everything else is ROM
+// or shows one of them
+int ownsPage(State *state, int page);
+
+// MEMORY ACCESS -- every read and write of the emulated memory goes through
+// these. They are inlined into the engines, and a 16 bit index can never be
+// outside the 64KB of memory, so the normal build does no bounds checking.
+// Configuring with -DEMULATOR_CHECKED_MEMORY=ON builds the debug flavour,
+// which checks that the page is mapped so that a bad access stops the
+// emulator straight away
+
+#ifdef EMULATOR_CHECKED_MEMORY
+static inline void checkAddress(State *state, uint32_t index,
+                                const char *access, int mapped) {
+    (void)state;
+    if (index > MAX_MEMORY_SIZE || !mapped) {
+        fprintf(stderr, "Memory %s out of bounds: 0x%04X\n", access, index);
+        exit(EXIT_FAILURE);
+    }
+}
+#else
+#define checkAddress(state, index, access, mapped)
+#endif
+
+// returns the byte at a certain index in the memory of the state machine
+static inline uint8_t readByte(State *state, uint16_t index) {
+    checkAddress(state, index, "read",
+                 state->readPages[index >> PAGE_SHIFT] != NULL);
+    return state->readPages[index >> PAGE_SHIFT][index & PAGE_MASK];
+}
+
+// inserts byte into a certain index in the memory array
+static inline void writeByte(State *state, uint16_t index, uint8_t value) {
+    uint8_t *page = state->writePages[index >> PAGE_SHIFT];
+    if (page != NULL) {
+        page[index & PAGE_MASK] = value;
+        return;
+    }
+
+    checkAddress(state, index, "write",
+                 state->writeHandlers[index >> PAGE_SHIFT] != NULL);
+    state->writeHandlers[index >> PAGE_SHIFT](state, index, value);
+}
+
+static inline uint8_t readByteAtSP(State *state) {
+    return readByte(state, state->sp);
+}
+
+// inserts byte into the stack pointer
+static inline void writeByteAtSP(State *state, uint8_t value) {
+    writeByte(state, state->sp, value);
+}
+
+static inline uint8_t nextByte(State *state) {
+    return readByte(state, state->pc++);
+}
+
+static inline uint16_t nextWord(State *state) {
+    uint8_t lowByte = readByte(state, state->pc);
+    uint8_t highByte = readByte(state, (uint16_t)(state->pc + 1));
+    state->pc += 2;
+
+    return (highByte << 8) | lowByte;
+}
+
+// get value of the address pointed to by a register pair
+static inline uint8_t readMemoryAtRegPair(State *state, uint8_t highByte,
+                                          uint8_t lowByte) {
+    return readByte(state, (highByte << 8) | lowByte);
+}
+
+static inline uint8_t readMemoryAtHL(State *state) {
+    return readByte(state, (state->h << 8) | state->l);
+}
+
+// set a value to the address pointed to by a register pair
+static inline void writeMemoryAtRegPair(State *state, uint8_t highByte,
+                                        uint8_t lowByte, uint8_t value) {
+    writeByte(state, (highByte << 8) | lowByte, value);
+}
+
+static inline void writeMemoryAtHL(State *state, uint8_t value) {
+    writeByte(state, (state->h << 8) | state->l, value);
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include "ports.h"
+
+static uint8_t readNothing(State *state, uint8_t port) {
+    (void)state;
+    (void)port;
+    return 0x00;
+}
+
+static void writeNothing(State *state, uint8_t port, uint8_t value) {
+    (void)state;
+    (void)port;
+    (void)value;
+}
+
+void mapPort(State *state, uint8_t port, PortReader reader,
+             PortWriter writer) {
+    state->portReaders[port] = reader != NULL ? reader : readNothing;
+    state->portWriters[port] = writer != NULL ? writer : writeNothing;
+}
+
+void clearPorts(State *state) {
+    for (int port = 0; port < PORT_COUNT; port++) {
+        mapPort(state, port, NULL, NULL);
+    }
+}
+
+void setInputPort(State *state, uint8_t port, uint8_t value) {
+    state->inputPorts[port % INPUT_PORT_COUNT] = value;
+}
+
+static uint8_t readInput(State *state, uint8_t port) {
+    return state->inputPorts[port];
+}
+
+// the midway shift register keeps the last two bytes written to port 4, and
+// port 3 reads 8 of those 16 bits, starting from the offset written to port 2
+static void writeShiftOffset(State *state, uint8_t port, uint8_t value) {
+    (void)port;
+    state->shiftOffset = value & 0x07;
+}
+
+static void writeShiftData(State *state, uint8_t port, uint8_t value) {
+    (void)port;
+    state->shiftRegister = (value << 8) | (state->shiftRegister >> 8);
+}
+
+static uint8_t readShiftResult(State *state, uint8_t port) {
+    (void)port;
+    return (uint8_t)(state->shiftRegister >> (8 - state->shiftOffset));
+}
+
+void mapSpaceInvadersPorts(State *state) {
+    clearPorts(state);
+
+    mapPort(state, 0, readInput, NULL);
+    mapPort(state, 1, readInput, NULL);
+    mapPort(state, 2, readInput, writeShiftOffset);
+    mapPort(state, 3, readShiftResult, NULL);
+    mapPort(state, 4, NULL, writeShiftData);
+
+    // port 0 is not read by the game, but has these bits set on the board
+    setInputPort(state, 0, 0x0e);
+    setInputPort(state, 1, PORT1_ALWAYS_SET);
+    setInputPort(state, 2, 0x00);
+}
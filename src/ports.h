@@ -0,0 +1,47 @@
+#ifndef PORTS_H
+#define PORTS_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+// PORTS -- IN and OUT look the port number up in the port table on the state
+// and call the device mapped there. setupStateMachine maps every port to a
+// device that reads as 0 and ignores writes, so unmapped ports cost nothing
+
+// maps the device functions to a port. A NULL reader or writer leaves that
+// direction of the port unmapped
+void mapPort(State *state, uint8_t port, PortReader reader, PortWriter writer);
+
+// maps every port to the empty device
+void clearPorts(State *state);
+
+// space invaders: inputs on ports 0, 1 and 2 and the shift register on ports
+// 2, 3 and 4. Sound and watchdog writes on ports 3, 5 and 6 are ignored
+void mapSpaceInvadersPorts(State *state);
+
+// sets the bits an input port reads as, e.g. the buttons held down
+void setInputPort(State *state, uint8_t port, uint8_t value);
+
+// space invaders input bits
+#define PORT1_CREDIT (1 << 0)
+#define PORT1_P2_START (1 << 1)
+#define PORT1_P1_START (1 << 2)
+#define PORT1_ALWAYS_SET (1 << 3)
+#define PORT1_P1_SHOT (1 << 4)
+#define PORT1_P1_LEFT (1 << 5)
+#define PORT1_P1_RIGHT (1 << 6)
+#define PORT2_TILT (1 << 2)
+#define PORT2_P2_SHOT (1 << 4)
+#define PORT2_P2_LEFT (1 << 5)
+#define PORT2_P2_RIGHT (1 << 6)
+
+static inline uint8_t readPort(State *state, uint8_t port) {
+    return state->portReaders[port](state, port);
+}
+
+static inline void writePort(State *state, uint8_t port, uint8_t value) {
+    state->portWriters[port](state, port, value);
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disassemble.h"
+
+// rows of each table in the report
+#define HOTTEST_OPCODES 20
+#define HOTTEST_ADDRESSES 40
+
+Profile *startProfile(State *state) {
+    Profile *profile = calloc(1, sizeof(Profile));
+    if (profile == NULL) {
+        perror("Failed to allocate the profile");
+        return NULL;
+    }
+    profile->lastAddress = state->pc;
+    profile->lastOpcode = readByte(state, state->pc);
+    profile->lastCycles = state->cycles;
+    return profile;
+}
+
+// qsort has no context argument, so the table being ranked is kept here
+static const uint64_t *rankedCycles;
+
+static int hotterFirst(const void *left, const void *right) {
+    uint64_t leftCycles = rankedCycles[*(const int *)left];
+    uint64_t rightCycles = rankedCycles[*(const int *)right];
+    return leftCycles < rightCycles ? 1 : leftCycles > rightCycles ? -1 : 0;
+}
+
+// fills order with the indices of cycles, the most cycles first
+static void rank(int *order, const uint64_t *cycles, int count) {
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    rankedCycles = cycles;
+    qsort(order, count, sizeof(int), hotterFirst);
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total == 0 ? 0 : 100.0 * part / total;
+}
+
+void stopProfile(Profile *profile, State *state) {
+    // charges the instruction that ran last
+    uint64_t spent = state->cycles - profile->lastCycles;
+    profile->addressCycles[profile->lastAddress] += spent;
+    profile->opcodeCycles[profile->lastOpcode] += spent;
+
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    for (int opcode = 0; opcode < 256; opcode++) {
+        instructions += profile->opcodeHits[opcode];
+        cycles += profile->opcodeCycles[opcode];
+    }
+
+    // the memory as the disassembler wants it, with room for the operands of
+    // an instruction at the last address
+    static unsigned char code[MEMORY_SIZE + 2];
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        code[address] = readByte(state, address);
+    }
+
+    // the address each opcode ran at most, to show an example of it
+    int hottestAddress[256];
+    memset(hottestAddress, 0xff, sizeof(hottestAddress));
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        int *hottest = &hottestAddress[code[address]];
+        if (profile->addressHits[address] > 0 &&
+            (*hottest < 0 || profile->addressCycles[address] >
+                                 profile->addressCycles[*hottest])) {
+            *hottest = address;
+        }
+    }
+
+    printf("\nprofile: %llu instructions, %llu cycles\n",
+           (unsigned long long)instructions, (unsigned long long)cycles);
+
+    static int order[MEMORY_SIZE];
+    rank(order, profile->opcodeCycles, 256);
+    printf("\n%-6s %12s %6s %12s %6s  %s\n", "opcode", "runs", "runs%",
+           "cycles", "cyc%", "hottest at");
+    for (int i = 0; i < HOTTEST_OPCODES; i++) {
+        int opcode = order[i];
+        if (profile->opcodeHits[opcode] == 0) {
+            break;
+        }
+        printf("    %02x %12llu %5.1f%% %12llu %5.1f%%  ", opcode,
+               (unsigned long long)profile->opcodeHits[opcode],
+               percent(profile->opcodeHits[opcode], instructions),
+               (unsigned long long)profile->opcodeCycles[opcode],
+               percent(profile->opcodeCycles[opcode], cycles));
+
+        // code that was overwritten since it ran has no address to show
+        if (hottestAddress[opcode] < 0) {
+            printf("-\n");
+        } else {
+            Disassemble8080p(code, hottestAddress[opcode]);
+        }
+    }
+
+    rank(order, profile->addressCycles, MEMORY_SIZE);
+    printf("\n%-7s %12s %12s %6s %6s  %s\n", "address", "runs", "cycles",
+           "cyc%", "total%", "instruction");
+    uint64_t total = 0;
+    for (int i = 0; i < HOTTEST_ADDRESSES; i++) {
+        int address = order[i];
+        if (profile->addressHits[address] == 0) {
+            break;
+        }
+        total += profile->addressCycles[address];
+        printf("   %04x %12llu %12llu %5.1f%% %5.1f%%  ", address,
+               (unsigned long long)profile->addressHits[address],
+               (unsigned long long)profile->addressCycles[address],
+               percent(profile->addressCycles[address], cycles),
+               percent(total, cycles));
+        Disassemble8080p(code, address);
+    }
+
+    free(profile);
+}
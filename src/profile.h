@@ -0,0 +1,67 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+#include "memory.h"
+
+// PROFILER -- counts how often every opcode and every address runs and the
+// cycles spent on each, and prints the hottest of them with their
+// disassembly. It is only built when configured with -DEMULATOR_PROFILER=ON,
+// which makes PROFILE_STEP count every instruction the interpreters run and
+// turns the jit engine into the block engine, as compiled code can't be
+// counted. Otherwise PROFILE_STEP is empty and the engines are exactly what
+// they would be without it.
+//
+// An instruction is charged the cycles that pass until the next one starts,
+// so the cycles of a taken conditional are counted and an interrupt is
+// charged to the instruction it came after
+
+typedef struct Profile {
+    uint64_t opcodeHits[256];
+    uint64_t opcodeCycles[256];
+    uint64_t addressHits[MEMORY_SIZE];
+    uint64_t addressCycles[MEMORY_SIZE];
+
+    // the instruction that is running, and the cycle count it started at
+    uint16_t lastAddress;
+    uint8_t lastOpcode;
+    uint64_t lastCycles;
+} Profile;
+
+// starts counting from the current cycle count, returns NULL on failure
+Profile *startProfile(State *state);
+
+// prints the hottest opcodes and addresses to stdout, disassembled from the
+// memory of the state, and frees the profile
+void stopProfile(Profile *profile, State *state);
+
+static inline void profileStep(State *state) {
+    Profile *profile = state->profile;
+    uint64_t spent = state->cycles - profile->lastCycles;
+    profile->addressCycles[profile->lastAddress] += spent;
+    profile->opcodeCycles[profile->lastOpcode] += spent;
+
+    uint16_t pc = state->pc;
+    uint8_t opcode = readByte(state, pc);
+    profile->addressHits[pc]++;
+    profile->opcodeHits[opcode]++;
+    profile->lastAddress = pc;
+    profile->lastOpcode = opcode;
+    profile->lastCycles = state->cycles;
+}
+
+// called by the interpreters before every instruction, with state->pc at
+// the opcode
+#ifdef EMULATOR_PROFILER
+#define PROFILE_STEP(state)                                                    \
+    do {                                                                       \
+        if ((state)->profile != NULL)                                          \
+            profileStep(state);                                                \
+    } while (0)
+#else
+#define PROFILE_STEP(state)
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+#include "rewind.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "blocks.h"
+#include "fork.h"
+#include "memory.h"
+#include "video.h"
+
+static void saveRegisters(RewindFrame *frame, State *state) {
+    frame->a = state->a;
+    frame->b = state->b;
+    frame->c = state->c;
+    frame->d = state->d;
+    frame->e = state->e;
+    frame->h = state->h;
+    frame->l = state->l;
+    frame->flags = state->flags;
+    frame->sp = state->sp;
+    frame->pc = state->pc;
+    frame->interruptEnabled = state->interruptEnabled;
+    frame->halted = state->halted;
+    frame->shiftOffset = state->shiftOffset;
+    frame->shiftRegister = state->shiftRegister;
+    memcpy(frame->inputPorts, state->inputPorts, INPUT_PORT_COUNT);
+    frame->cycles = state->cycles;
+}
+
+static void restoreRegisters(State *state, const RewindFrame *frame) {
+    state->a = frame->a;
+    state->b = frame->b;
+    state->c = frame->c;
+    state->d = frame->d;
+    state->e = frame->e;
+    state->h = frame->h;
+    state->l = frame->l;
+    state->flags = frame->flags;
+    state->lazyOp = 0;
+    state->sp = frame->sp;
+    state->pc = frame->pc;
+    state->interruptEnabled = frame->interruptEnabled;
+    state->halted = frame->halted;
+    state->shiftOffset = frame->shiftOffset;
+    state->shiftRegister = frame->shiftRegister;
+    memcpy(state->inputPorts, frame->inputPorts, INPUT_PORT_COUNT);
+    state->cycles = frame->cycles;
+}
+
+Rewind *createRewind(State *state, int frames, size_t memoryLimit) {
+    Rewind *rewind = calloc(1, sizeof(Rewind));
+    if (rewind == NULL) {
+        return NULL;
+    }
+
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (ownsPage(state, page)) {
+            rewind->pages[rewind->pageCount++] = page;
+        }
+    }
+
+    // enough slots for every frame to change every page, unless that is more
+    // than the limit
+    size_t slots = (size_t)frames * rewind->pageCount;
+    if (slots > memoryLimit / PAGE_SIZE) {
+        slots = memoryLimit / PAGE_SIZE;
+    }
+
+    rewind->frameCapacity = frames;
+    rewind->slotCapacity = (uint32_t)slots;
+    rewind->frames = calloc(frames, sizeof(RewindFrame));
+    rewind->slots = malloc(slots * PAGE_SIZE);
+    rewind->slotPages = malloc(slots);
+    rewind->copies = malloc((size_t)rewind->pageCount * PAGE_SIZE);
+    if (rewind->frames == NULL || rewind->slots == NULL ||
+        rewind->slotPages == NULL || rewind->copies == NULL) {
+        freeRewind(rewind);
+        return NULL;
+    }
+
+    for (int i = 0; i < rewind->pageCount; i++) {
+        memcpy(rewind->copies[i], state->readPages[rewind->pages[i]],
+               PAGE_SIZE);
+    }
+    saveRegisters(&rewind->current, state);
+    return rewind;
+}
+
+void freeRewind(Rewind *rewind) {
+    free(rewind->frames);
+    free(rewind->slots);
+    free(rewind->slotPages);
+    free(rewind->copies);
+    free(rewind);
+}
+
+static void dropOldestFrame(Rewind *rewind) {
+    rewind->slotsUsed -= rewind->frames[rewind->oldestFrame].pageCount;
+    rewind->oldestFrame = (rewind->oldestFrame + 1) % rewind->frameCapacity;
+    rewind->frameCount--;
+}
+
+void rewindPush(Rewind *rewind, State *state) {
+    uint8_t changed[PAGE_COUNT];
+    uint32_t changedCount = 0;
+    for (int i = 0; i < rewind->pageCount; i++) {
+        if (memcmp(rewind->copies[i], state->readPages[rewind->pages[i]],
+                   PAGE_SIZE) != 0) {
+            changed[changedCount++] = i;
+        }
+    }
+
+    while (rewind->frameCount > 0 &&
+           (rewind->frameCount == rewind->frameCapacity ||
+            rewind->slotsUsed + changedCount > rewind->slotCapacity)) {
+        dropOldestFrame(rewind);
+    }
+
+    // a frame that doesn't fit even in an empty buffer can't be stepped back
+    // over, so the frames before it are gone
+    int keep = changedCount <= rewind->slotCapacity;
+    RewindFrame *frame = &rewind->frames[(rewind->oldestFrame +
+                                          rewind->frameCount) %
+                                         rewind->frameCapacity];
+    *frame = rewind->current;
+    frame->firstSlot = rewind->nextSlot;
+    frame->pageCount = keep ? changedCount : 0;
+
+    for (uint32_t i = 0; i < changedCount; i++) {
+        uint8_t *copy = rewind->copies[changed[i]];
+        if (keep) {
+            uint32_t slot = rewind->nextSlot;
+            memcpy(rewind->slots[slot], copy, PAGE_SIZE);
+            rewind->slotPages[slot] = changed[i];
+            rewind->nextSlot = (slot + 1) % rewind->slotCapacity;
+        }
+        memcpy(copy, state->readPages[rewind->pages[changed[i]]], PAGE_SIZE);
+    }
+
+    if (keep) {
+        rewind->slotsUsed += changedCount;
+        rewind->frameCount++;
+    }
+    saveRegisters(&rewind->current, state);
+}
+
+int rewindFrames(Rewind *rewind, State *state, int frames) {
+    int stepped = 0;
+    int codeChanged = 0;
+    while (stepped < frames && rewind->frameCount > 0) {
+        RewindFrame *frame =
+            &rewind->frames[(rewind->oldestFrame + rewind->frameCount - 1) %
+                            rewind->frameCapacity];
+
+        for (uint32_t i = 0; i < frame->pageCount; i++) {
+            uint32_t slot = (frame->firstSlot + i) % rewind->slotCapacity;
+            int page = rewind->pages[rewind->slotPages[slot]];
+            unsharePage(state, page);
+            memcpy(state->readPages[page], rewind->slots[slot], PAGE_SIZE);
+            memcpy(rewind->copies[rewind->slotPages[slot]],
+                   rewind->slots[slot], PAGE_SIZE);
+
+            // the page was written to behind the back of the block cache
+            codeChanged |= state->blockCache != NULL &&
+                           state->blockCache->trapped[page];
+        }
+
+        rewind->nextSlot = frame->firstSlot;
+        rewind->slotsUsed -= frame->pageCount;
+        rewind->frameCount--;
+        rewind->current = *frame;
+        stepped++;
+    }
+
+    if (stepped > 0) {
+        restoreRegisters(state, &rewind->current);
+        markVideoDirty(state);
+    }
+    if (codeChanged) {
+        flushBlockCache(state);
+    }
+    return stepped;
+}
+
+size_t rewindMemory(Rewind *rewind) {
+    return sizeof(Rewind) +
+           (size_t)rewind->frameCapacity * sizeof(RewindFrame) +
+           (size_t)rewind->slotCapacity * (PAGE_SIZE + 1) +
+           (size_t)rewind->pageCount * PAGE_SIZE;
+}
+
+size_t rewindMemoryUsed(Rewind *rewind) {
+    return (size_t)rewind->frameCount * sizeof(RewindFrame) +
+           (size_t)rewind->slotsUsed * (PAGE_SIZE + 1);
+}
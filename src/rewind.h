@@ -0,0 +1,76 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+// REWIND -- keeps the last few seconds of a run in memory so that it can be
+// stepped back a frame at a time. After every frame rewindPush compares the
+// RAM with a copy of it from the frame before, and keeps the old bytes of the
+// pages the frame changed along with the registers the frame started with.
+// Stepping back a frame copies those pages back, so it costs a memcpy for
+// each page the frame changed. Everything is allocated up front, a ring of
+// frames and a ring of page slots, and when either of them is full the oldest
+// frames are dropped to make room
+
+// how a frame started, and which page slots hold the pages it changed
+typedef struct RewindFrame {
+    uint8_t a, b, c, d, e, h, l, flags;
+    uint16_t sp;
+    uint16_t pc;
+    uint8_t interruptEnabled;
+    uint8_t halted;
+    uint8_t shiftOffset;
+    uint16_t shiftRegister;
+    uint8_t inputPorts[INPUT_PORT_COUNT];
+    uint64_t cycles;
+
+    uint32_t firstSlot;
+    uint32_t pageCount;
+} RewindFrame;
+
+typedef struct Rewind {
+    // ring of the frames that can be stepped back to, oldest first
+    RewindFrame *frames;
+    int frameCapacity;
+    int oldestFrame;
+    int frameCount;
+
+    // ring of the old contents of changed pages, each slot also remembers
+    // which of the tracked pages it belongs to
+    uint8_t (*slots)[PAGE_SIZE];
+    uint8_t *slotPages;
+    uint32_t slotCapacity;
+    uint32_t nextSlot;
+    uint32_t slotsUsed;
+
+    // the pages that hold the state of the machine, see ownsPage, and a copy
+    // of each of them from the last push
+    int pageCount;
+    uint8_t pages[PAGE_COUNT];
+    uint8_t (*copies)[PAGE_SIZE];
+
+    // the registers at the last push, the start of the next frame
+    RewindFrame current;
+} Rewind;
+
+// keeps up to frames frames, in at most memoryLimit bytes of page slots.
+// Returns NULL if the memory can't be allocated
+Rewind *createRewind(State *state, int frames, size_t memoryLimit);
+void freeRewind(Rewind *rewind);
+
+// remembers the frame that has just run, called between frames
+void rewindPush(Rewind *rewind, State *state);
+
+// puts the machine back the given number of frames, or as far back as the
+// buffer goes. Only called straight after rewindPush, and returns the number
+// of frames it went back
+int rewindFrames(Rewind *rewind, State *state, int frames);
+
+// bytes allocated for the buffer, and the part of it holding frames
+size_t rewindMemory(Rewind *rewind);
+size_t rewindMemoryUsed(Rewind *rewind);
+
+#endif
@@ -0,0 +1,97 @@
+#include "rom.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memory.h"
+
+const RomPart invadersRomSet[INVADERS_PART_COUNT] = {
+    {"invaders.h", 0x0000},
+    {"invaders.g", 0x0800},
+    {"invaders.f", 0x1000},
+    {"invaders.e", 0x1800},
+};
+
+int openRom(Rom *rom, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror(filename);
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size == 0) {
+        fprintf(stderr, "Failed to read ROM %s\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    // the mapping outlives the file descriptor
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Failed to map ROM");
+        return -1;
+    }
+
+    rom->data = data;
+    rom->size = info.st_size;
+    return 0;
+}
+
+void closeRom(Rom *rom) {
+    if (rom->data != NULL) {
+        munmap(rom->data, rom->size);
+    }
+    rom->data = NULL;
+    rom->size = 0;
+}
+
+void mapRomImage(State *state, const Rom *rom, uint16_t address) {
+    // the 8080 can only see up to the end of its address space
+    size_t size = rom->size;
+    size_t visible = (size_t)MEMORY_SIZE - address;
+    if (size > visible) {
+        size = visible;
+    }
+
+    // the last page can run past the end of the file. mmap works in whole
+    // host pages, which are a multiple of PAGE_SIZE, so those bytes read as 0
+    size = (size + PAGE_MASK) & ~(size_t)PAGE_MASK;
+    mapRom(state, address, size, rom->data);
+}
+
+int openRomSet(const char *directory, const RomPart *parts, int count,
+               Rom *roms) {
+    for (int i = 0; i < count; i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", directory, parts[i].filename);
+
+        int misaligned = (parts[i].address & PAGE_MASK) != 0;
+        if (misaligned) {
+            fprintf(stderr, "ROM %s does not start on a page boundary\n",
+                    path);
+        }
+        if (misaligned || openRom(&roms[i], path) < 0) {
+            for (int j = 0; j < i; j++) {
+                closeRom(&roms[j]);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int loadRomSet(State *state, const char *directory, const RomPart *parts,
+               int count, Rom *roms) {
+    if (openRomSet(directory, parts, count, roms) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        mapRomImage(state, &roms[i], parts[i].address);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+// a ROM image mapped read only into the address space of the process. The
+// bytes are never copied, the ROM pages of every State that loads it point
+// straight at data, and the page cache is shared with every other process
+// that maps the same file
+typedef struct Rom {
+    uint8_t *data;
+    size_t size;
+} Rom;
+
+// one file of a ROM set and the address it is loaded at
+typedef struct RomPart {
+    const char *filename;
+    uint16_t address;
+} RomPart;
+
+// the four 2KB files that make up the space invaders ROM
+#define INVADERS_PART_COUNT 4
+extern const RomPart invadersRomSet[INVADERS_PART_COUNT];
+
+// maps the file read only. Returns 0 on success and -1 on failure
+int openRom(Rom *rom, const char *filename);
+void closeRom(Rom *rom);
+
+// maps an opened ROM as the ROM pages starting at address, which has to be
+// the start of a page
+void mapRomImage(State *state, const Rom *rom, uint16_t address);
+
+// opens every part of a ROM set from directory without mapping them into a
+// machine. roms has to have room for count entries. Returns 0 on success and
+// -1 on failure, in which case none of them are left open
+int openRomSet(const char *directory, const RomPart *parts, int count,
+               Rom *roms);
+
+// opens every part of a ROM set from directory and maps it at its address.
+// roms has to have room for count entries, and the parts stay mapped until
+// they are closed with closeRom. Returns 0 on success and -1 on failure
+int loadRomSet(State *state, const char *directory, const RomPart *parts,
+               int count, Rom *roms);
+
+#endif
@@ -0,0 +1,215 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blocks.h"
+#include "fork.h"
+#include "memory.h"
+#include "video.h"
+
+static const char snapshotMagic[8] = {'8', '0', '8', '0', 'S', 'N', 'A', 'P'};
+
+static void put16(uint8_t *at, uint16_t value) {
+    at[0] = value & 0xff;
+    at[1] = value >> 8;
+}
+
+static void put64(uint8_t *at, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        at[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint16_t get16(const uint8_t *at) {
+    return at[0] | (at[1] << 8);
+}
+
+static uint64_t get64(const uint8_t *at) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t)at[i] << (8 * i);
+    }
+    return value;
+}
+
+static int isRomPage(State *state, int page) {
+    return state->writePages[page] == state->discardPage;
+}
+
+// FNV-1a hash of every ROM page along with its address
+static uint64_t hashRom(State *state) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (!isRomPage(state, page)) {
+            continue;
+        }
+        hash = (hash ^ page) * 0x100000001b3ULL;
+        for (int i = 0; i < PAGE_SIZE; i++) {
+            hash = (hash ^ state->readPages[page][i]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+static int isZeroPage(const uint8_t *page) {
+    for (int i = 0; i < PAGE_SIZE; i++) {
+        if (page[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int saveSnapshot(State *state, const char *path) {
+    uint8_t header[SNAPSHOT_HEADER_SIZE] = {0};
+    memcpy(header, snapshotMagic, sizeof(snapshotMagic));
+    put16(header + 8, SNAPSHOT_VERSION);
+
+    // outside of the engines the flags are always worked out already
+    uint8_t registers[8] = {state->a, state->b, state->c, state->d,
+                            state->e, state->h, state->l, state->flags};
+    memcpy(header + 10, registers, sizeof(registers));
+    put16(header + 18, state->sp);
+    put16(header + 20, state->pc);
+    header[22] = state->interruptEnabled | state->halted << 1;
+    header[23] = state->shiftOffset;
+    put16(header + 24, state->shiftRegister);
+    memcpy(header + 26, state->inputPorts, INPUT_PORT_COUNT);
+    put64(header + 30, state->cycles);
+    put64(header + 38, hashRom(state));
+
+    int pageCount = 0;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (ownsPage(state, page) && !isZeroPage(state->readPages[page])) {
+            header[48 + page / 8] |= 1 << (page % 8);
+            pageCount++;
+        }
+    }
+    put16(header + 46, pageCount);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    int failed = fwrite(header, sizeof(header), 1, file) != 1;
+    for (int page = 0; page < PAGE_COUNT && !failed; page++) {
+        if (header[48 + page / 8] & (1 << (page % 8))) {
+            failed = fwrite(state->readPages[page], PAGE_SIZE, 1, file) != 1;
+        }
+    }
+
+    if (fclose(file) != 0 || failed) {
+        fprintf(stderr, "Failed to write snapshot %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// returns 1 if the saved pages are ones this machine would have saved too
+static int pagesMatch(State *state, const uint8_t *bitmap, int pageCount) {
+    int count = 0;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (bitmap[page / 8] & (1 << (page % 8))) {
+            if (!ownsPage(state, page)) {
+                return 0;
+            }
+            count++;
+        }
+    }
+    return count == pageCount;
+}
+
+int loadSnapshot(State *state, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < SNAPSHOT_HEADER_SIZE) {
+        fprintf(stderr, "Snapshot %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+
+    const uint8_t *data =
+        mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Failed to map snapshot");
+        return -1;
+    }
+
+    const char *error = NULL;
+    int version = get16(data + 8);
+    int pageCount = get16(data + 46);
+    if (memcmp(data, snapshotMagic, sizeof(snapshotMagic)) != 0) {
+        error = "is not a snapshot";
+    } else if (version < 1 || version > SNAPSHOT_VERSION) {
+        error = "has an unsupported version";
+    } else if (get64(data + 38) != hashRom(state)) {
+        error = "was saved with different ROMs";
+    } else if (!pagesMatch(state, data + 48, pageCount)) {
+        error = "was saved with a different memory map";
+    } else if (info.st_size !=
+               SNAPSHOT_HEADER_SIZE + (off_t)pageCount * PAGE_SIZE) {
+        error = "is truncated";
+    }
+    if (error != NULL) {
+        fprintf(stderr, "Snapshot %s %s\n", path, error);
+        munmap((void *)data, info.st_size);
+        return -1;
+    }
+
+    // the code that was cached is about to be overwritten
+    if (state->blockCache != NULL) {
+        flushBlockCache(state);
+    }
+
+    state->a = data[10];
+    state->b = data[11];
+    state->c = data[12];
+    state->d = data[13];
+    state->e = data[14];
+    state->h = data[15];
+    state->l = data[16];
+    state->flags = (data[17] & PSW_FLAGS) | PSW_FIXED_BITS;
+    state->lazyOp = 0;
+    state->sp = get16(data + 18);
+    state->pc = get16(data + 20);
+    state->interruptEnabled = data[22] & 1;
+    state->halted = version >= 2 ? (data[22] >> 1) & 1 : 0;
+    state->shiftOffset = data[23] & 0x07;
+    state->shiftRegister = get16(data + 24);
+    memcpy(state->inputPorts, data + 26, INPUT_PORT_COUNT);
+    state->cycles = get64(data + 30);
+
+    // the pages that weren't saved were all zero
+    const uint8_t *saved = data + SNAPSHOT_HEADER_SIZE;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (!ownsPage(state, page)) {
+            continue;
+        }
+        unsharePage(state, page);
+        if (data[48 + page / 8] & (1 << (page % 8))) {
+            memcpy(state->readPages[page], saved, PAGE_SIZE);
+            saved += PAGE_SIZE;
+        } else {
+            memset(state->readPages[page], 0, PAGE_SIZE);
+        }
+    }
+
+    // every column of the picture may have changed
+    markVideoDirty(state);
+
+    munmap((void *)data, info.st_size);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+// SNAPSHOTS -- a save state holds the registers, the interrupt and device
+// state and the memory of a machine, so a run can carry on from it later.
+// Memory is saved as a delta against the machine as it is straight after its
+// ROMs are loaded: ROM pages, mirrors of other pages and pages that are
+// still all zero are left out, which brings a space invaders snapshot down
+// to the few KB of RAM the game has used. A snapshot can only be loaded into
+// a machine with the same memory map and the same ROMs, which is checked
+// with a hash of the ROM pages.
+//
+// The file is a fixed size header followed by the saved pages in page order.
+// Every number in it is little endian
+//   0  magic "8080SNAP"
+//   8  version, currently SNAPSHOT_VERSION
+//   10 a, b, c, d, e, h, l and the PSW flags
+//   18 sp, pc
+//   22 interruptEnabled in bit 0 and halted in bit 1, shiftOffset,
+//      shiftRegister, 4 input ports
+//   30 cycles
+//   38 hash of the ROM pages
+//   46 number of saved pages, then a 256 bit map of which pages they are
+//   80 the saved pages, 256 bytes each
+//
+// Version 1 had only interruptEnabled in byte 22, as HLT could not be saved
+// then. Those snapshots still load, as a cpu that is not halted
+
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_HEADER_SIZE 80
+
+// saves the machine to path. Returns 0 on success and -1 on failure
+int saveSnapshot(State *state, const char *path);
+
+// loads a snapshot saved by a machine with the same ROMs into state, which
+// has to have its memory map set up already. Returns 0 on success and -1 on
+// failure, and leaves the machine as it was when the file is rejected
+int loadSnapshot(State *state, const char *path);
+
+#endif
@@ -0,0 +1,66 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char traceMagic[8] = {'8', '0', '8', '0', 'T', 'R', 'C', 'E'};
+
+// writes all of data, carrying on after partial writes
+static int writeAll(int fd, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            return -1;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return 0;
+}
+
+Trace *startTrace(const char *path) {
+    Trace *trace = malloc(sizeof(Trace));
+    if (trace == NULL) {
+        perror("Failed to allocate the trace buffer");
+        return NULL;
+    }
+    memset(trace, 0, sizeof(Trace) - sizeof(trace->records));
+
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace->fd < 0) {
+        perror(path);
+        free(trace);
+        return NULL;
+    }
+
+    uint8_t header[TRACE_HEADER_SIZE];
+    memcpy(header, traceMagic, sizeof(traceMagic));
+    header[8] = TRACE_VERSION & 0xff;
+    header[9] = TRACE_VERSION >> 8;
+    header[10] = sizeof(TraceRecord) & 0xff;
+    header[11] = sizeof(TraceRecord) >> 8;
+    trace->failed = writeAll(trace->fd, header, sizeof(header)) < 0;
+    return trace;
+}
+
+void flushTrace(Trace *trace) {
+    if (!trace->failed && trace->count > 0) {
+        trace->failed = writeAll(trace->fd, trace->records,
+                                 trace->count * sizeof(TraceRecord)) < 0;
+        if (!trace->failed) {
+            trace->written += trace->count;
+        }
+    }
+    trace->count = 0;
+}
+
+int stopTrace(Trace *trace) {
+    flushTrace(trace);
+    int failed = close(trace->fd) != 0 || trace->failed;
+    free(trace);
+    return failed ? -1 : 0;
+}
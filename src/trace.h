@@ -0,0 +1,116 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "memory.h"
+
+// TRACING -- the trace engine writes a fixed size record of every instruction
+// it runs into a large buffer, which is written to the trace file with a
+// single write() whenever the next slice of cycles might not fit, so tracing
+// costs a few stores per instruction instead of a printf. The file is the
+// magic "8080TRCE", a 16 bit version and the 16 bit record size, followed by
+// the records. Every number in it is little endian. `disassembler --trace
+// file` prints them
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 12
+
+// records held in the buffer, 768KB. A larger buffer no longer fits in the
+// cache, and then every record store misses
+#define TRACE_BUFFER_RECORDS (1 << 16)
+
+// the registers as they were just before the instruction ran, at the offsets
+// traceNextOpcode packs them at. Read the 16 bit fields with littleEndian16
+typedef struct TraceRecord {
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t hl;
+    uint8_t opcode;
+    uint8_t operands[2]; // the two bytes after the opcode, used or not
+    uint8_t a;
+    uint8_t flags;
+    uint8_t unused;
+} TraceRecord;
+
+struct Trace {
+    int fd;
+    int failed; // set if a write failed, the rest of the trace is dropped
+    uint32_t count; // records in the buffer
+    uint64_t written; // records written to the file
+    TraceRecord records[TRACE_BUFFER_RECORDS];
+};
+
+// creates the trace file, returns NULL on failure
+Trace *startTrace(const char *path);
+
+// writes the records in the buffer to the file
+void flushTrace(Trace *trace);
+
+// flushes and closes the trace. Returns 0 if every record was written
+int stopTrace(Trace *trace);
+
+// the records are packed into words as numbers, and the words are swapped to
+// little endian before they are stored. On a little endian host the swaps do
+// nothing, and the instruction bytes are read with one load the same way
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static inline uint16_t littleEndian16(uint16_t value) {
+    return __builtin_bswap16(value);
+}
+static inline uint32_t littleEndian32(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+static inline uint64_t littleEndian64(uint64_t value) {
+    return __builtin_bswap64(value);
+}
+#else
+static inline uint16_t littleEndian16(uint16_t value) { return value; }
+static inline uint32_t littleEndian32(uint32_t value) { return value; }
+static inline uint64_t littleEndian64(uint64_t value) { return value; }
+#endif
+
+// the fewest cycles any instruction takes. The trace engine only starts a
+// slice of cycles once the buffer has room for every instruction it could
+// run, so the records are stored without checking for room
+#define TRACE_MIN_INSTRUCTION_CYCLES 4
+
+// used by the trace engine in place of nextByte: stores the record of the
+// instruction at pc and returns its opcode. The opcode and operands come from
+// the one page lookup the fetch needs anyway, and the record is packed into
+// two words and stored with two stores, the compiler reloads the state after
+// every separate byte store because a byte can alias anything
+static inline uint8_t traceNextOpcode(State *state) {
+    Trace *trace = state->trace;
+    uint16_t pc = state->pc;
+
+    // the operands are nearly always on the same page as the opcode, and are
+    // then read with the opcode in one load
+    const uint8_t *code = state->readPages[pc >> PAGE_SHIFT] + (pc & PAGE_MASK);
+    uint32_t instruction;
+    if ((pc & PAGE_MASK) <= PAGE_SIZE - sizeof(instruction)) {
+        memcpy(&instruction, code, sizeof(instruction));
+        instruction = littleEndian32(instruction);
+    } else {
+        instruction = code[0] |
+                      (readByte(state, (uint16_t)(pc + 1)) << 8) |
+                      (readByte(state, (uint16_t)(pc + 2)) << 16);
+    }
+
+    uint64_t low = pc | ((uint64_t)state->sp << 16) |
+                   ((uint64_t)state->h << 40) | ((uint64_t)state->l << 32) |
+                   ((uint64_t)instruction << 48);
+    uint32_t high = ((instruction >> 16) & 0xff) | (state->a << 8) |
+                    (state->flags << 16);
+
+    low = littleEndian64(low);
+    high = littleEndian32(high);
+    uint8_t *record = (uint8_t *)&trace->records[trace->count++];
+    memcpy(record, &low, sizeof(low));
+    memcpy(record + sizeof(low), &high, sizeof(high));
+
+    state->pc = pc + 1;
+    return (uint8_t)instruction;
+}
+
+#endif
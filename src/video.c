@@ -0,0 +1,223 @@
+#include "video.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "fork.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VIDEO_X86 1
+#endif
+
+// every renderer first transposes the columns it converts, so that byte i of
+// every column ends up in one row of bytes. That row holds 8 rows of the
+// upright screen, one for each bit, and turning a bit of it into pixels is
+// the same operation for every byte of the row, which is what SIMD is good at
+static void transposeColumns(const uint8_t *videoRam, int first, int count,
+                             uint8_t rows[BYTES_PER_COLUMN][SCREEN_WIDTH]) {
+    for (int x = first; x < first + count; x++) {
+        const uint8_t *column = videoRam + x * BYTES_PER_COLUMN;
+        for (int i = 0; i < BYTES_PER_COLUMN; i++) {
+            rows[i][x] = column[i];
+        }
+    }
+}
+
+// bit b of byte i of a column is pixel i * 8 + b of the scanline, counting up
+// from the bottom of the upright screen
+static uint8_t *screenRow(uint8_t *pixels, int i, int bit) {
+    return pixels + (SCREEN_HEIGHT - 1 - (i * 8 + bit)) * SCREEN_WIDTH;
+}
+
+static void renderScalar(const uint8_t *videoRam, uint8_t *pixels, int first,
+                         int count) {
+    uint8_t rows[BYTES_PER_COLUMN][SCREEN_WIDTH];
+    transposeColumns(videoRam, first, count, rows);
+
+    for (int i = 0; i < BYTES_PER_COLUMN; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            uint8_t *row = screenRow(pixels, i, bit);
+            uint8_t mask = 1 << bit;
+            for (int x = first; x < first + count; x++) {
+                row[x] = (rows[i][x] & mask) ? 0xff : 0x00;
+            }
+        }
+    }
+}
+
+static int always(void) {
+    return 1;
+}
+
+#ifdef VIDEO_X86
+
+// (byte & mask) == mask is all ones for a set bit and all zeroes otherwise,
+// which is exactly the pixel
+__attribute__((target("sse2"))) static void
+renderSse2(const uint8_t *videoRam, uint8_t *pixels, int first, int count) {
+    uint8_t rows[BYTES_PER_COLUMN][SCREEN_WIDTH];
+    transposeColumns(videoRam, first, count, rows);
+
+    for (int i = 0; i < BYTES_PER_COLUMN; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            uint8_t *row = screenRow(pixels, i, bit);
+            __m128i mask = _mm_set1_epi8((char)(1 << bit));
+            for (int x = first; x < first + count; x += 16) {
+                __m128i bytes = _mm_loadu_si128((const __m128i *)&rows[i][x]);
+                __m128i set = _mm_cmpeq_epi8(_mm_and_si128(bytes, mask), mask);
+                _mm_storeu_si128((__m128i *)&row[x], set);
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void
+renderAvx2(const uint8_t *videoRam, uint8_t *pixels, int first, int count) {
+    uint8_t rows[BYTES_PER_COLUMN][SCREEN_WIDTH];
+    transposeColumns(videoRam, first, count, rows);
+
+    for (int i = 0; i < BYTES_PER_COLUMN; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            uint8_t *row = screenRow(pixels, i, bit);
+            __m256i mask = _mm256_set1_epi8((char)(1 << bit));
+            for (int x = first; x < first + count; x += 32) {
+                __m256i bytes =
+                    _mm256_loadu_si256((const __m256i *)&rows[i][x]);
+                __m256i set =
+                    _mm256_cmpeq_epi8(_mm256_and_si256(bytes, mask), mask);
+                _mm256_storeu_si256((__m256i *)&row[x], set);
+            }
+        }
+    }
+}
+
+static int hasSse2(void) {
+    return __builtin_cpu_supports("sse2");
+}
+
+static int hasAvx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+// the fastest renderer comes first
+const Renderer renderers[] = {
+#ifdef VIDEO_X86
+    {"avx2", renderAvx2, hasAvx2},
+    {"sse2", renderSse2, hasSse2},
+#endif
+    {"scalar", renderScalar, always},
+};
+
+const int rendererCount = sizeof(renderers) / sizeof(renderers[0]);
+
+const Renderer *bestRenderer(void) {
+    for (int i = 0; i < rendererCount; i++) {
+        if (renderers[i].available()) {
+            return &renderers[i];
+        }
+    }
+    return &renderers[rendererCount - 1];
+}
+
+const Renderer *findRenderer(const char *name) {
+    for (int i = 0; i < rendererCount; i++) {
+        if (strcmp(renderers[i].name, name) == 0 && renderers[i].available()) {
+            return &renderers[i];
+        }
+    }
+    return NULL;
+}
+
+// the video RAM byte a write to the address ends up in, counted from the
+// start of the video RAM. It is outside the video RAM when the page is not
+// part of it
+static long videoOffset(State *state, uint16_t address) {
+    uint8_t *byte =
+        state->readPages[address >> PAGE_SHIFT] + (address & PAGE_MASK);
+    return (long)((intptr_t)byte - (intptr_t)(state->memory + VIDEO_RAM_START));
+}
+
+static void writeVideo(State *state, uint16_t address, uint8_t value) {
+    long offset = videoOffset(state, address);
+    uint8_t *byte = state->memory + VIDEO_RAM_START + offset;
+    if (*byte == value) {
+        return;
+    }
+
+    *byte = value;
+    int column = offset / BYTES_PER_COLUMN;
+    state->dirtyColumns[column >> 6] |= (uint64_t)1 << (column & 63);
+}
+
+void trackVideoWrites(State *state) {
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        long offset = videoOffset(state, page << PAGE_SHIFT);
+        if (offset >= 0 && offset < VIDEO_RAM_SIZE &&
+            state->writePages[page] != NULL) {
+            state->writePages[page] = NULL;
+            state->writeHandlers[page] = writeVideo;
+        }
+    }
+
+    markVideoDirty(state);
+}
+
+void markVideoDirty(State *state) {
+    for (int column = 0; column < SCREEN_WIDTH; column++) {
+        state->dirtyColumns[column >> 6] |= (uint64_t)1 << (column & 63);
+    }
+}
+
+void renderDirtyColumns(State *state, const Renderer *renderer,
+                        uint8_t *pixels) {
+    const uint8_t *video = videoRam(state);
+
+    for (int first = 0; first < SCREEN_WIDTH; first += STRIP_WIDTH) {
+        uint64_t *word = &state->dirtyColumns[first >> 6];
+        uint64_t strip = (((uint64_t)1 << STRIP_WIDTH) - 1) << (first & 63);
+        if (*word & strip) {
+            *word &= ~strip;
+            renderer->render(video, pixels, first, STRIP_WIDTH);
+        }
+    }
+}
+
+const uint8_t *videoRam(State *state) {
+    // a fork can have copied some of the pages and still share the rest,
+    // then the copies of all of them are in one piece again
+    int first = VIDEO_RAM_START >> PAGE_SHIFT;
+    int last = (VIDEO_RAM_START + VIDEO_RAM_SIZE - 1) >> PAGE_SHIFT;
+    for (int page = first + 1; page <= last; page++) {
+        if (state->readPages[page] !=
+            state->readPages[first] + ((page - first) << PAGE_SHIFT)) {
+            for (page = first; page <= last; page++) {
+                unsharePage(state, page);
+            }
+            break;
+        }
+    }
+    return state->readPages[first];
+}
+
+int writePpm(const char *path, const uint8_t *pixels) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+        uint8_t rgb[3] = {pixels[i], pixels[i], pixels[i]};
+        fwrite(rgb, 1, sizeof(rgb), file);
+    }
+
+    if (fclose(file) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
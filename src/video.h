@@ -0,0 +1,73 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+// VIDEO -- space invaders draws a 1 bit per pixel picture in the RAM at
+// 0x2400-0x3fff. Each 32 byte column of it is one scanline of a 256x224
+// screen, lowest bit first, and the monitor is mounted rotated a quarter turn
+// anticlockwise. The renderers turn it into an upright 224x256 picture with
+// one grayscale byte per pixel, 0x00 for black and 0xff for white
+#define VIDEO_RAM_START 0x2400
+#define VIDEO_RAM_SIZE 0x1c00
+#define SCREEN_WIDTH 224
+#define SCREEN_HEIGHT 256
+#define BYTES_PER_COLUMN (SCREEN_HEIGHT / 8)
+
+// the renderers convert strips of this many columns, so SCREEN_WIDTH
+// columns is 7 strips
+#define STRIP_WIDTH 32
+
+// converts count columns of the video RAM starting at column first, into
+// the same columns of SCREEN_WIDTH * SCREEN_HEIGHT pixels stored one row after
+// another from the top of the screen. first and count have to be multiples of
+// STRIP_WIDTH, and passing 0 and SCREEN_WIDTH converts the whole frame
+typedef void (*RenderFunction)(const uint8_t *videoRam, uint8_t *pixels,
+                               int first, int count);
+
+// a renderer that can be picked by name. available returns 0 when the cpu the
+// emulator is running on lacks the instructions the renderer uses
+typedef struct Renderer {
+    const char *name;
+    RenderFunction render;
+    int (*available)(void);
+} Renderer;
+
+extern const Renderer renderers[];
+extern const int rendererCount;
+
+// the fastest renderer the cpu supports
+const Renderer *bestRenderer(void);
+
+// returns the renderer called name, or NULL if there is none the cpu supports
+const Renderer *findRenderer(const char *name);
+
+// DIRTY COLUMNS -- a frame of space invaders only changes a few columns of
+// the video RAM. Once the writes are tracked, each write that changes a byte
+// of the video RAM marks its column in state->dirtyColumns, and
+// renderDirtyColumns only converts the strips holding those columns again
+
+// sends writes to the video RAM, and to every mirror of it, through the write
+// handler that marks columns dirty. Every column starts out dirty
+void trackVideoWrites(State *state);
+
+// marks every column dirty, for when all of the video RAM may have changed
+void markVideoDirty(State *state);
+
+// converts every strip with a dirty column into pixels with renderer, and
+// clears the dirty bits. pixels has to hold the last picture rendered for the
+// machine
+void renderDirtyColumns(State *state, const Renderer *renderer,
+                        uint8_t *pixels);
+
+// returns the video RAM of the machine, the pages of it are always mapped
+// one after another
+const uint8_t *videoRam(State *state);
+
+// writes the pixels to a binary PPM file. Returns 0 on success and -1 on
+// failure
+int writePpm(const char *path, const uint8_t *pixels);
+
+#endif